@@ -0,0 +1,62 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atomic_file.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+namespace {
+	/**
+	 * @return a name next to filename that no other write of this or another
+	 *         running process uses
+	 */
+	std::string GetTempFilename(const std::string& filename) {
+		static std::atomic<unsigned long> counter{0};
+#ifdef _WIN32
+		unsigned long pid = GetCurrentProcessId();
+#else
+		unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+		return filename + "." + std::to_string(pid) + "." +
+			std::to_string(counter++) + ".tmp";
+	}
+}
+
+bool WriteFileAtomic(const std::string& filename,
+		const std::vector<unsigned char>& data) {
+	std::string temp_filename = GetTempFilename(filename);
+	std::ofstream file(temp_filename.c_str(), std::ofstream::binary);
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	file.close();
+
+	std::error_code ec;
+	if (file) {
+		std::filesystem::rename(temp_filename, filename, ec);
+		if (!ec) {
+			return true;
+		}
+	}
+	std::filesystem::remove(temp_filename, ec);
+	return false;
+}
@@ -0,0 +1,35 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLS_ATOMIC_FILE
+#define TOOLS_ATOMIC_FILE
+
+#include <string>
+#include <vector>
+
+/**
+ * Writes a file through a temporary file that replaces it at the end, so
+ * that an interrupted run never leaves a cut off file behind.
+ *
+ * @param filename file to write
+ * @param data content
+ * @return false when the file could not be written
+ */
+bool WriteFileAtomic(const std::string& filename,
+	const std::vector<unsigned char>& data);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLS_JSON
+#define TOOLS_JSON
+
+#include <string>
+
+/**
+ * Quotes a string for JSON output. Quotes, backslashes and all control
+ * characters below 0x20 are escaped, other bytes are passed through.
+ *
+ * @param str UTF-8 text
+ * @return str as JSON string, with the quotes
+ */
+std::string JsonString(const std::string& str);
+
+#endif
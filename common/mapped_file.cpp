@@ -0,0 +1,117 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const std::string& filename) {
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		return false;
+	}
+	size = static_cast<size_t>(file_size.QuadPart);
+
+	// Empty files cannot be mapped
+	if (size > 0) {
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			data = static_cast<const unsigned char*>(
+				MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		}
+	}
+	CloseHandle(file);
+
+	if (size > 0 && !data) {
+		Close();
+		return false;
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat file_info;
+	if (fstat(fd, &file_info) != 0 || !S_ISREG(file_info.st_mode)) {
+		close(fd);
+		return false;
+	}
+	size = static_cast<size_t>(file_info.st_size);
+
+	// Empty files cannot be mapped
+	if (size > 0) {
+		void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			size = 0;
+			return false;
+		}
+		data = static_cast<const unsigned char*>(mapped);
+	}
+	close(fd);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+		mapping = nullptr;
+	}
+#else
+	if (data) {
+		munmap(const_cast<unsigned char*>(data), size);
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+const unsigned char* MappedFile::GetData() const {
+	return data;
+}
+
+size_t MappedFile::GetSize() const {
+	return size;
+}
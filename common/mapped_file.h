@@ -0,0 +1,61 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLS_MAPPED_FILE
+#define TOOLS_MAPPED_FILE
+
+#include <cstddef>
+#include <string>
+
+/**
+ * Read-only view of a whole file mapped into memory, so that reading it
+ * neither allocates nor copies.
+ */
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	 * Maps a file, replacing the file mapped before.
+	 *
+	 * @param filename file to map
+	 * @return false when the file cannot be opened or mapped
+	 */
+	bool Open(const std::string& filename);
+
+	/** Unmaps the file. */
+	void Close();
+
+	/** @return start of the file content, null for an empty file */
+	const unsigned char* GetData() const;
+
+	/** @return size of the file in bytes */
+	size_t GetSize() const;
+
+private:
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* mapping = nullptr;
+#endif
+};
+
+#endif
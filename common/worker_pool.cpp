@@ -0,0 +1,129 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+
+struct WorkerPool::Batch {
+	const std::function<void(size_t)>* job = nullptr;
+	size_t count = 0;
+	std::atomic<size_t> next{0};
+
+	std::mutex mutex;
+	std::condition_variable finished_cv;
+	size_t finished = 0;
+};
+
+WorkerPool::WorkerPool(unsigned threads) {
+	for (unsigned i = 1; i < threads; ++i) {
+		workers.emplace_back(&WorkerPool::WorkerMain, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeup.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+unsigned WorkerPool::GetThreadCount() const {
+	return static_cast<unsigned>(workers.size()) + 1;
+}
+
+unsigned WorkerPool::GetDefaultThreadCount() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool WorkerPool::RunOne(Batch& batch) {
+	size_t index = batch.next++;
+	if (index >= batch.count) {
+		return false;
+	}
+
+	(*batch.job)(index);
+
+	std::lock_guard<std::mutex> lock(batch.mutex);
+	if (++batch.finished == batch.count) {
+		batch.finished_cv.notify_all();
+	}
+	return true;
+}
+
+void WorkerPool::WorkerMain() {
+	for (;;) {
+		std::shared_ptr<Batch> batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeup.wait(lock, [this] { return stopping || !batches.empty(); });
+			if (batches.empty()) {
+				return;
+			}
+			batch = batches.front();
+		}
+
+		if (!RunOne(*batch)) {
+			// Everything is handed out, stop offering this batch
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = std::find(batches.begin(), batches.end(), batch);
+			if (it != batches.end()) {
+				batches.erase(it);
+			}
+		}
+	}
+}
+
+void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& job) {
+	if (count == 0) {
+		return;
+	}
+
+	if (workers.empty() || count == 1) {
+		for (size_t i = 0; i < count; ++i) {
+			job(i);
+		}
+		return;
+	}
+
+	auto batch = std::make_shared<Batch>();
+	batch->job = &job;
+	batch->count = count;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		batches.push_back(batch);
+	}
+	wakeup.notify_all();
+
+	while (RunOne(*batch)) {}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = std::find(batches.begin(), batches.end(), batch);
+		if (it != batches.end()) {
+			batches.erase(it);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->finished_cv.wait(lock, [&batch] { return batch->finished == batch->count; });
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLS_WORKER_POOL
+#define TOOLS_WORKER_POOL
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that run batches of indexed jobs.
+ *
+ * The thread calling ParallelFor always takes part in its own batch, so
+ * batches can be nested (a job may start another batch) without deadlocking
+ * when all workers are busy: the caller then simply runs the rest alone.
+ */
+class WorkerPool {
+public:
+	/**
+	 * @param threads total number of threads working on a batch, including
+	 *        the calling thread. 0 and 1 run everything on the caller.
+	 */
+	explicit WorkerPool(unsigned threads);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	/** @return total number of threads, including the calling thread */
+	unsigned GetThreadCount() const;
+
+	/**
+	 * Calls job(i) once for every i in [0, count) and returns when all of
+	 * them have finished. Jobs are started in ascending index order.
+	 */
+	void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+	/** @return number of hardware threads, at least 1 */
+	static unsigned GetDefaultThreadCount();
+
+private:
+	struct Batch;
+
+	void WorkerMain();
+	static bool RunOne(Batch& batch);
+
+	std::vector<std::thread> workers;
+	std::deque<std::shared_ptr<Batch>> batches;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "zopfli_callbacks.h"
+
+#include <memory>
+#include "context.h"
+#include "worker_pool.h"
+
+int IsBudgetUsed(void* context, size_t inend) {
+	const Budget& budget = *static_cast<const Budget*>(context);
+	std::chrono::duration<double, std::milli> elapsed =
+		std::chrono::steady_clock::now() - budget.start;
+	return elapsed.count() >= budget.ms * inend / budget.size;
+}
+
+void RunZopfliJobs(void* context, size_t numjobs, ZopfliJobFun* job, void* arg) {
+	static_cast<WorkerPool*>(context)->ParallelFor(numjobs, [job, arg](size_t i) {
+		job(arg, i);
+	});
+}
+
+ZopfliContext* GetZopfliContext(void*) {
+	thread_local std::unique_ptr<ZopfliContext, void (*)(ZopfliContext*)> zopfli{
+		ZopfliCreateContext(), ZopfliDestroyContext };
+	return zopfli.get();
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLS_ZOPFLI_CALLBACKS
+#define TOOLS_ZOPFLI_CALLBACKS
+
+#include <chrono>
+#include <cstddef>
+#include "zopfli.h"
+
+/** Time a Zopfli run may take, spread over the input by position. */
+struct Budget {
+	std::chrono::steady_clock::time_point start;
+	double ms;
+	size_t size;
+};
+
+/**
+ * Stops the iterations on a block when the block used up its share of the
+ * Budget given as context. Time left over by earlier blocks goes to the
+ * later ones.
+ * type: ZopfliStopFun
+ */
+int IsBudgetUsed(void* context, size_t inend);
+
+/**
+ * Runs Zopfli jobs on the WorkerPool given as context.
+ * type: ZopfliRunJobsFun
+ */
+void RunZopfliJobs(void* context, size_t numjobs, ZopfliJobFun* job, void* arg);
+
+/**
+ * Gives Zopfli the memory of the calling thread, Zopfli jobs of one file
+ * can run on other threads. The hash tables, LZ77 stores and block arrays
+ * are kept for the next run on the thread.
+ * type: ZopfliGetContextFun
+ */
+struct ZopfliContext* GetZopfliContext(void* context);
+
+#endif
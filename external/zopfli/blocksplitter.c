@@ -23,6 +23,7 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "context.h"
 #include "deflate.h"
 #include "squeeze.h"
 #include "tree.h"
@@ -35,26 +36,85 @@ context: for your implementation
 */
 typedef double FindMinimumFun(size_t i, void* context);
 
+/* Shared state of the FindMinimumJob jobs of one round. */
+typedef struct FindMinimumContext {
+  FindMinimumFun* f;
+  void* context;
+  /* Probe points of the round, or the start of the range of every chunk. */
+  const size_t* p;
+  /* End of the range of every chunk, NULL for single probes. */
+  const size_t* pend;
+  /* Receives the value of every probe or the smallest value of every chunk. */
+  double* vp;
+  /* Receives where the smallest value of every chunk is. */
+  size_t* vi;
+} FindMinimumContext;
+
+/*
+Evaluates probe point index, or finds the minimum in chunk index.
+type: ZopfliJobFun
+*/
+static void FindMinimumJob(void* arg, size_t index) {
+  const FindMinimumContext* c = (const FindMinimumContext*)arg;
+  size_t i;
+  if (!c->pend) {
+    c->vp[index] = c->f(c->p[index], c->context);
+    return;
+  }
+  c->vp[index] = ZOPFLI_LARGE_FLOAT;
+  c->vi[index] = c->p[index];
+  for (i = c->p[index]; i < c->pend[index]; i++) {
+    double v = c->f(i, c->context);
+    if (v < c->vp[index]) {
+      c->vp[index] = v;
+      c->vi[index] = i;
+    }
+  }
+}
+
 /*
 Finds minimum of function f(i) where is is of type size_t, f(i) is of type
 double, i is in range start-end (excluding end).
 Outputs the minimum value in *smallest and returns the index of this value.
+The evaluations of f run as jobs of options->runjobs, so f must be safe to call
+concurrently. The result is the same as evaluating one after another.
 */
-static size_t FindMinimum(FindMinimumFun f, void* context,
+static size_t FindMinimum(const ZopfliOptions* options,
+                          FindMinimumFun f, void* context,
                           size_t start, size_t end, double* smallest) {
+  FindMinimumContext c;
+  c.f = f;
+  c.context = context;
   if (end - start < 1024) {
+    /* Scan everything, in consecutive chunks. */
+#define NUMCHUNKS 8
+    size_t p[NUMCHUNKS];
+    size_t pend[NUMCHUNKS];
+    double vp[NUMCHUNKS];
+    size_t vi[NUMCHUNKS];
+    size_t numchunks = end - start < NUMCHUNKS ? end - start : NUMCHUNKS;
     double best = ZOPFLI_LARGE_FLOAT;
     size_t result = start;
     size_t i;
-    for (i = start; i < end; i++) {
-      double v = f(i, context);
-      if (v < best) {
-        best = v;
-        result = i;
+    for (i = 0; i < numchunks; i++) {
+      p[i] = start + i * (end - start) / numchunks;
+      pend[i] = start + (i + 1) * (end - start) / numchunks;
+    }
+    c.p = p;
+    c.pend = pend;
+    c.vp = vp;
+    c.vi = vi;
+    ZopfliRunJobs(options, numchunks, FindMinimumJob, &c);
+    /* Lower chunks win ties, like the lower index in a single scan. */
+    for (i = 0; i < numchunks; i++) {
+      if (vp[i] < best) {
+        best = vp[i];
+        result = vi[i];
       }
     }
     *smallest = best;
     return result;
+#undef NUMCHUNKS
   } else {
     /* Try to find minimum faster by recursively checking multiple points. */
 #define NUM 9  /* Good value: 9. */
@@ -66,13 +126,17 @@ static size_t FindMinimum(FindMinimumFun f, void* context,
     double lastbest = ZOPFLI_LARGE_FLOAT;
     size_t pos = start;
 
+    c.p = p;
+    c.pend = 0;
+    c.vp = vp;
+    c.vi = 0;
     for (;;) {
       if (end - start <= NUM) break;
 
       for (i = 0; i < NUM; i++) {
         p[i] = start + (i + 1) * ((end - start) / (NUM + 1));
-        vp[i] = f(p[i], context);
       }
+      ZopfliRunJobs(options, NUM, FindMinimumJob, &c);
       besti = 0;
       best = vp[0];
       for (i = 1; i < NUM; i++) {
@@ -127,6 +191,47 @@ static double SplitCost(size_t i, void* context) {
   return EstimateCost(c->lz77, c->start, i) + EstimateCost(c->lz77, i, c->end);
 }
 
+/* Result of trying to split the lz77 block from start to end (not inclusive). */
+typedef struct SplitCandidate {
+  size_t start;
+  size_t end;
+  /* Best split point. */
+  size_t pos;
+  /* Cost of both halves when splitting at pos. */
+  double splitcost;
+  /* Cost of the block without splitting. */
+  double origcost;
+} SplitCandidate;
+
+/* Shared state of the EvaluateSplitJob jobs. */
+typedef struct EvaluateSplitContext {
+  const ZopfliOptions* options;
+  const ZopfliLZ77Store* lz77;
+  SplitCandidate* candidates;
+} EvaluateSplitContext;
+
+/* Finds the best split point of a block and the costs with and without it. */
+static void EvaluateSplit(const ZopfliOptions* options,
+                          const ZopfliLZ77Store* lz77, SplitCandidate* block) {
+  SplitCostContext c;
+  c.lz77 = lz77;
+  c.start = block->start;
+  c.end = block->end;
+  assert(block->start < block->end);
+  block->pos = FindMinimum(options, SplitCost, &c, block->start + 1,
+                           block->end, &block->splitcost);
+  block->origcost = EstimateCost(lz77, block->start, block->end);
+}
+
+/*
+Evaluates the split of candidate index.
+type: ZopfliJobFun
+*/
+static void EvaluateSplitJob(void* arg, size_t index) {
+  const EvaluateSplitContext* c = (const EvaluateSplitContext*)arg;
+  EvaluateSplit(c->options, c->lz77, &c->candidates[index]);
+}
+
 static void AddSorted(size_t value, size_t** out, size_t* outsize) {
   size_t i;
   ZOPFLI_APPEND_DATA(value, out, outsize);
@@ -217,10 +322,11 @@ void ZopfliBlockSplitLZ77(const ZopfliOptions* options,
                           size_t** splitpoints, size_t* npoints) {
   size_t lstart, lend;
   size_t i;
-  size_t llpos = 0;
   size_t numblocks = 1;
   unsigned char* done;
-  double splitcost, origcost;
+  /* Halves evaluated ahead of time with options->speculativesplit. */
+  SplitCandidate* evaluated = 0;
+  size_t numevaluated = 0;
 
   if (lz77->size < 10) return;  /* This code fails on tiny files. */
 
@@ -231,28 +337,58 @@ void ZopfliBlockSplitLZ77(const ZopfliOptions* options,
   lstart = 0;
   lend = lz77->size;
   for (;;) {
-    SplitCostContext c;
+    SplitCandidate block;
 
     if (maxblocks > 0 && numblocks >= maxblocks) {
       break;
     }
 
-    c.lz77 = lz77;
-    c.start = lstart;
-    c.end = lend;
-    assert(lstart < lend);
-    llpos = FindMinimum(SplitCost, &c, lstart + 1, lend, &splitcost);
-
-    assert(llpos > lstart);
-    assert(llpos < lend);
+    block.start = lstart;
+    block.end = lend;
+    for (i = 0; i < numevaluated; i++) {
+      if (evaluated[i].start == lstart && evaluated[i].end == lend) break;
+    }
+    if (i < numevaluated) {
+      block = evaluated[i];
+      evaluated[i] = evaluated[--numevaluated];
+    } else {
+      EvaluateSplit(options, lz77, &block);
+    }
 
-    origcost = EstimateCost(lz77, lstart, lend);
+    assert(block.pos > lstart);
+    assert(block.pos < lend);
 
-    if (splitcost > origcost || llpos == lstart + 1 || llpos == lend) {
+    if (block.splitcost > block.origcost || block.pos == lstart + 1 ||
+        block.pos == lend) {
       done[lstart] = 1;
     } else {
-      AddSorted(llpos, splitpoints, npoints);
+      AddSorted(block.pos, splitpoints, npoints);
       numblocks++;
+
+      /* Both halves are split candidates now. Evaluating them together
+      already gives the result of the one picked later. */
+      if (options->speculativesplit && options->runjobs &&
+          (maxblocks == 0 || numblocks < maxblocks)) {
+        EvaluateSplitContext c;
+        SplitCandidate halves[2];
+        halves[0].start = lstart;
+        halves[0].end = block.pos;
+        halves[1].start = block.pos;
+        halves[1].end = lend;
+        if (halves[0].end - halves[0].start >= 10 &&
+            halves[1].end - halves[1].start >= 10) {
+          c.options = options;
+          c.lz77 = lz77;
+          c.candidates = halves;
+          ZopfliRunJobs(options, 2, EvaluateSplitJob, &c);
+          for (i = 0; i < 2; i++) {
+            evaluated = (SplitCandidate*)realloc(evaluated,
+                sizeof(*evaluated) * (numevaluated + 1));
+            if (!evaluated) exit(-1); /* Allocation failed. */
+            evaluated[numevaluated++] = halves[i];
+          }
+        }
+      }
     }
 
     if (!FindLargestSplittableBlock(
@@ -269,6 +405,7 @@ void ZopfliBlockSplitLZ77(const ZopfliOptions* options,
     PrintBlockSplitPoints(lz77, *splitpoints, *npoints);
   }
 
+  free(evaluated);
   free(done);
 }
 
@@ -284,9 +421,9 @@ void ZopfliBlockSplit(const ZopfliOptions* options,
   ZopfliHash hash;
   ZopfliHash* h = &hash;
 
-  ZopfliInitLZ77Store(in, &store);
+  ZopfliAcquireLZ77Store(options, in, &store);
   ZopfliInitBlockState(options, instart, inend, 0, &s);
-  ZopfliAllocHash(ZOPFLI_WINDOW_SIZE, h);
+  ZopfliAcquireHash(options, h);
 
   *npoints = 0;
   *splitpoints = 0;
@@ -315,8 +452,8 @@ void ZopfliBlockSplit(const ZopfliOptions* options,
 
   free(lz77splitpoints);
   ZopfliCleanBlockState(&s);
-  ZopfliCleanLZ77Store(&store);
-  ZopfliCleanHash(h);
+  ZopfliReleaseLZ77Store(options, &store);
+  ZopfliReleaseHash(options, h);
 }
 
 void ZopfliBlockSplitSimple(const unsigned char* in,
@@ -25,24 +25,41 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 
 #ifdef ZOPFLI_LONGEST_MATCH_CACHE
 
-void ZopfliInitCache(size_t blocksize, ZopfliLongestMatchCache* lmc) {
-  size_t i;
+void ZopfliInitCache(size_t blocksize, size_t cachelength,
+                     ZopfliLongestMatchCache* lmc) {
+  lmc->cachelength = cachelength;
   lmc->length = (unsigned short*)malloc(sizeof(unsigned short) * blocksize);
   lmc->dist = (unsigned short*)malloc(sizeof(unsigned short) * blocksize);
   /* Rather large amount of memory. */
-  lmc->sublen = (unsigned char*)malloc(ZOPFLI_CACHE_LENGTH * 3 * blocksize);
+  lmc->sublen = (unsigned char*)malloc(cachelength * 3 * blocksize + 1);
   if(lmc->sublen == NULL) {
     fprintf(stderr,
         "Error: Out of memory. Tried allocating %lu bytes of memory.\n",
-        (unsigned long)ZOPFLI_CACHE_LENGTH * 3 * blocksize);
+        (unsigned long)cachelength * 3 * blocksize);
     exit (EXIT_FAILURE);
   }
+  ZopfliResetCache(blocksize, lmc);
+}
+
+void ZopfliResetCache(size_t blocksize, ZopfliLongestMatchCache* lmc) {
+  size_t i;
+  size_t cachelength = lmc->cachelength;
 
   /* length > 0 and dist 0 is invalid combination, which indicates on purpose
   that this cache value is not filled in yet. */
   for (i = 0; i < blocksize; i++) lmc->length[i] = 1;
   for (i = 0; i < blocksize; i++) lmc->dist[i] = 0;
-  for (i = 0; i < ZOPFLI_CACHE_LENGTH * blocksize * 3; i++) lmc->sublen[i] = 0;
+  for (i = 0; i < cachelength * blocksize * 3; i++) lmc->sublen[i] = 0;
+}
+
+int ZopfliCacheLengthForSize(size_t blocksize, size_t maxsize) {
+  size_t perpos;
+  size_t fixed = 2 * sizeof(unsigned short);
+  if (maxsize == 0 || blocksize == 0) return ZOPFLI_CACHE_LENGTH;
+  perpos = maxsize / blocksize;
+  if (perpos < fixed) return -1;
+  perpos = (perpos - fixed) / 3;
+  return perpos < ZOPFLI_CACHE_LENGTH ? (int)perpos : ZOPFLI_CACHE_LENGTH;
 }
 
 void ZopfliCleanCache(ZopfliLongestMatchCache* lmc) {
@@ -59,11 +76,10 @@ void ZopfliSublenToCache(const unsigned short* sublen,
   unsigned bestlength = 0;
   unsigned char* cache;
 
-#if ZOPFLI_CACHE_LENGTH == 0
-  return;
-#endif
+  size_t cachelength = lmc->cachelength;
+  if (cachelength == 0) return;
 
-  cache = &lmc->sublen[ZOPFLI_CACHE_LENGTH * pos * 3];
+  cache = &lmc->sublen[cachelength * pos * 3];
   if (length < 3) return;
   for (i = 3; i <= length; i++) {
     if (i == length || sublen[i] != sublen[i + 1]) {
@@ -72,12 +88,12 @@ void ZopfliSublenToCache(const unsigned short* sublen,
       cache[j * 3 + 2] = (sublen[i] >> 8) % 256;
       bestlength = i;
       j++;
-      if (j >= ZOPFLI_CACHE_LENGTH) break;
+      if (j >= cachelength) break;
     }
   }
-  if (j < ZOPFLI_CACHE_LENGTH) {
+  if (j < cachelength) {
     assert(bestlength == length);
-    cache[(ZOPFLI_CACHE_LENGTH - 1) * 3] = bestlength - 3;
+    cache[(cachelength - 1) * 3] = bestlength - 3;
   } else {
     assert(bestlength <= length);
   }
@@ -91,12 +107,10 @@ void ZopfliCacheToSublen(const ZopfliLongestMatchCache* lmc,
   unsigned maxlength = ZopfliMaxCachedSublen(lmc, pos, length);
   unsigned prevlength = 0;
   unsigned char* cache;
-#if ZOPFLI_CACHE_LENGTH == 0
-  return;
-#endif
+  if (lmc->cachelength == 0) return;
   if (length < 3) return;
-  cache = &lmc->sublen[ZOPFLI_CACHE_LENGTH * pos * 3];
-  for (j = 0; j < ZOPFLI_CACHE_LENGTH; j++) {
+  cache = &lmc->sublen[lmc->cachelength * pos * 3];
+  for (j = 0; j < lmc->cachelength; j++) {
     unsigned length = cache[j * 3] + 3;
     unsigned dist = cache[j * 3 + 1] + 256 * cache[j * 3 + 2];
     for (i = prevlength; i <= length; i++) {
@@ -113,13 +127,11 @@ Returns the length up to which could be stored in the cache.
 unsigned ZopfliMaxCachedSublen(const ZopfliLongestMatchCache* lmc,
                                size_t pos, size_t length) {
   unsigned char* cache;
-#if ZOPFLI_CACHE_LENGTH == 0
-  return 0;
-#endif
-  cache = &lmc->sublen[ZOPFLI_CACHE_LENGTH * pos * 3];
+  if (lmc->cachelength == 0) return 0;
+  cache = &lmc->sublen[lmc->cachelength * pos * 3];
   (void)length;
   if (cache[1] == 0 && cache[2] == 0) return 0;  /* No sublen cached. */
-  return cache[(ZOPFLI_CACHE_LENGTH - 1) * 3] + 3;
+  return cache[(lmc->cachelength - 1) * 3] + 3;
 }
 
 #endif  /* ZOPFLI_LONGEST_MATCH_CACHE */
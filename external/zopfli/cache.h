@@ -40,10 +40,31 @@ typedef struct ZopfliLongestMatchCache {
   unsigned short* length;
   unsigned short* dist;
   unsigned char* sublen;
+  /* Amount of sublen entries per position, at most ZOPFLI_CACHE_LENGTH. */
+  size_t cachelength;
 } ZopfliLongestMatchCache;
 
-/* Initializes the ZopfliLongestMatchCache. */
-void ZopfliInitCache(size_t blocksize, ZopfliLongestMatchCache* lmc);
+/*
+Initializes the ZopfliLongestMatchCache with cachelength sublen entries per
+position. Fewer entries save memory, the cache then answers fewer queries, but
+the found matches stay the same.
+*/
+void ZopfliInitCache(size_t blocksize, size_t cachelength,
+                     ZopfliLongestMatchCache* lmc);
+
+/*
+Returns the amount of sublen entries per position that keeps the cache of a
+block within maxsize bytes, or -1 if not even the lengths and distances fit.
+maxsize 0 means no limit.
+*/
+int ZopfliCacheLengthForSize(size_t blocksize, size_t maxsize);
+
+/*
+Marks every entry of a cache for blocksize positions as not filled in yet. The
+arrays must already be large enough, for example from an earlier ZopfliInitCache
+of a larger block.
+*/
+void ZopfliResetCache(size_t blocksize, ZopfliLongestMatchCache* lmc);
 
 /* Frees up the memory of the ZopfliLongestMatchCache. */
 void ZopfliCleanCache(ZopfliLongestMatchCache* lmc);
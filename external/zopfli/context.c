@@ -0,0 +1,140 @@
+/*
+Copyright 2026 xyzcrush authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "context.h"
+
+#include "util.h"
+
+/*
+Placed in front of every buffer of ZopfliAcquireBuffer to remember its
+capacity. The union keeps the memory after it aligned for any type.
+*/
+typedef union BufferHeader {
+  size_t capacity;
+  double align_double;
+  void* align_pointer;
+} BufferHeader;
+
+static ZopfliContext* GetContext(const ZopfliOptions* options) {
+  if (!options->getcontext) return 0;
+  return options->getcontext(options->getcontext_context);
+}
+
+ZopfliContext* ZopfliCreateContext(void) {
+  ZopfliContext* context = (ZopfliContext*)malloc(sizeof(*context));
+  if (!context) exit(-1); /* Allocation failed. */
+  context->numhashes = 0;
+  context->numstores = 0;
+  context->numbuffers = 0;
+  return context;
+}
+
+void ZopfliDestroyContext(ZopfliContext* context) {
+  size_t i;
+  if (!context) return;
+  for (i = 0; i < context->numhashes; i++) {
+    ZopfliCleanHash(&context->hashes[i]);
+  }
+  for (i = 0; i < context->numstores; i++) {
+    ZopfliCleanLZ77Store(&context->stores[i]);
+  }
+  for (i = 0; i < context->numbuffers; i++) {
+    free(context->buffers[i]);
+  }
+  free(context);
+}
+
+void ZopfliAcquireHash(const ZopfliOptions* options, ZopfliHash* h) {
+  ZopfliContext* context = GetContext(options);
+  if (context && context->numhashes > 0) {
+    *h = context->hashes[--context->numhashes];
+  } else {
+    ZopfliAllocHash(ZOPFLI_WINDOW_SIZE, h);
+  }
+}
+
+void ZopfliReleaseHash(const ZopfliOptions* options, ZopfliHash* h) {
+  ZopfliContext* context = GetContext(options);
+  if (context && context->numhashes < ZOPFLI_CONTEXT_POOL_SIZE) {
+    context->hashes[context->numhashes++] = *h;
+  } else {
+    ZopfliCleanHash(h);
+  }
+}
+
+void ZopfliAcquireLZ77Store(const ZopfliOptions* options,
+                            const unsigned char* data, ZopfliLZ77Store* store) {
+  ZopfliContext* context = GetContext(options);
+  if (context && context->numstores > 0) {
+    *store = context->stores[--context->numstores];
+    ZopfliResetLZ77Store(data, store);
+  } else {
+    ZopfliInitLZ77Store(data, store);
+  }
+}
+
+void ZopfliReleaseLZ77Store(const ZopfliOptions* options,
+                            ZopfliLZ77Store* store) {
+  ZopfliContext* context = GetContext(options);
+  if (context && context->numstores < ZOPFLI_CONTEXT_POOL_SIZE &&
+      store->capacity > 0) {
+    context->stores[context->numstores++] = *store;
+  } else {
+    ZopfliCleanLZ77Store(store);
+  }
+}
+
+void* ZopfliAcquireBuffer(const ZopfliOptions* options, size_t size) {
+  ZopfliContext* context = GetContext(options);
+  BufferHeader* header = 0;
+  if (context && context->numbuffers > 0) {
+    /* The smallest buffer that fits, else grow the largest one. */
+    size_t best = context->numbuffers;
+    size_t largest = 0;
+    size_t i;
+    for (i = 0; i < context->numbuffers; i++) {
+      size_t capacity = ((BufferHeader*)context->buffers[i])->capacity;
+      if (capacity >= size && (best == context->numbuffers || capacity <
+          ((BufferHeader*)context->buffers[best])->capacity)) {
+        best = i;
+      }
+      if (capacity > ((BufferHeader*)context->buffers[largest])->capacity) {
+        largest = i;
+      }
+    }
+    if (best == context->numbuffers) best = largest;
+    header = (BufferHeader*)context->buffers[best];
+    context->buffers[best] = context->buffers[--context->numbuffers];
+  }
+  if (!header || header->capacity < size) {
+    header = (BufferHeader*)realloc(header, sizeof(*header) + size);
+    if (!header) exit(-1); /* Allocation failed. */
+    header->capacity = size;
+  }
+  return header + 1;
+}
+
+void ZopfliReleaseBuffer(const ZopfliOptions* options, void* buffer) {
+  ZopfliContext* context = GetContext(options);
+  BufferHeader* header;
+  if (!buffer) return;
+  header = (BufferHeader*)buffer - 1;
+  if (context && context->numbuffers < ZOPFLI_CONTEXT_POOL_SIZE) {
+    context->buffers[context->numbuffers++] = header;
+  } else {
+    free(header);
+  }
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2026 xyzcrush authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Memory that is kept between compressions, so that compressing many small inputs
+does not allocate and free the same hash tables, LZ77 stores and block sized
+arrays over and over. See ZopfliOptions.getcontext.
+
+A context belongs to one thread. The acquire functions take memory out of the
+context of the calling thread and the release functions give it to the context
+of the calling thread, which can be another one. Without a context they simply
+allocate and free.
+*/
+
+#ifndef ZOPFLI_CONTEXT_H_
+#define ZOPFLI_CONTEXT_H_
+
+#include <stdlib.h>
+
+#include "hash.h"
+#include "lz77.h"
+#include "zopfli.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Amount of hashes, stores and buffers a context keeps at most. */
+#define ZOPFLI_CONTEXT_POOL_SIZE 8
+
+typedef struct ZopfliContext {
+  ZopfliHash hashes[ZOPFLI_CONTEXT_POOL_SIZE];
+  size_t numhashes;
+
+  /* Empty stores that still have their memory. */
+  ZopfliLZ77Store stores[ZOPFLI_CONTEXT_POOL_SIZE];
+  size_t numstores;
+
+  /* Buffers of ZopfliAcquireBuffer, with their capacity in bytes. */
+  void* buffers[ZOPFLI_CONTEXT_POOL_SIZE];
+  size_t numbuffers;
+} ZopfliContext;
+
+/* Creates an empty context, free it with ZopfliDestroyContext. */
+ZopfliContext* ZopfliCreateContext(void);
+
+/* Frees the context and all memory it keeps. */
+void ZopfliDestroyContext(ZopfliContext* context);
+
+/* Gets an allocated hash, it still has to be reset before use. */
+void ZopfliAcquireHash(const ZopfliOptions* options, ZopfliHash* h);
+void ZopfliReleaseHash(const ZopfliOptions* options, ZopfliHash* h);
+
+/* Gets an empty LZ77 store for the given data. */
+void ZopfliAcquireLZ77Store(const ZopfliOptions* options,
+                            const unsigned char* data, ZopfliLZ77Store* store);
+void ZopfliReleaseLZ77Store(const ZopfliOptions* options,
+                            ZopfliLZ77Store* store);
+
+/*
+Gets uninitialized memory of at least size bytes. It must be given back with
+ZopfliReleaseBuffer, not with free.
+*/
+void* ZopfliAcquireBuffer(const ZopfliOptions* options, size_t size);
+void ZopfliReleaseBuffer(const ZopfliOptions* options, void* buffer);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  /* ZOPFLI_CONTEXT_H_ */
@@ -24,9 +24,11 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 #include <stdlib.h>
 
 #include "blocksplitter.h"
+#include "context.h"
 #include "squeeze.h"
 #include "symbols.h"
 #include "tree.h"
+#include "warmstart.h"
 
 /*
 bp = bitpointer, always in range [0, 7].
@@ -767,7 +769,7 @@ static void AddLZ77BlockAutoType(const ZopfliOptions* options, int final,
     AddBits(0, 7, bp, out, outsize);  /* end symbol has code 0000000 */
     return;
   }
-  ZopfliInitLZ77Store(lz77->data, &fixedstore);
+  ZopfliAcquireLZ77Store(options, lz77->data, &fixedstore);
   if (expensivefixed) {
     /* Recalculate the LZ77 with ZopfliLZ77OptimalFixed */
     size_t instart = lz77->pos[lstart];
@@ -796,7 +798,162 @@ static void AddLZ77BlockAutoType(const ZopfliOptions* options, int final,
                  expected_data_size, bp, out, outsize);
   }
 
-  ZopfliCleanLZ77Store(&fixedstore);
+  ZopfliReleaseLZ77Store(options, &fixedstore);
+}
+
+/* Shared state of the OptimizeBlockJob jobs of one part. */
+typedef struct OptimizeBlocksContext {
+  const ZopfliOptions* options;
+  const unsigned char* in;
+  size_t instart;
+  size_t inend;
+  /* Block boundaries as byte coordinates. */
+  const size_t* splitpoints;
+  size_t npoints;
+  /* Receives the optimized LZ77 data, one store per block. */
+  ZopfliLZ77Store* stores;
+} OptimizeBlocksContext;
+
+/*
+Runs the squeeze optimization on one block between two split points.
+type: ZopfliJobFun
+*/
+static void OptimizeBlockJob(void* arg, size_t i) {
+  const OptimizeBlocksContext* c = (const OptimizeBlocksContext*)arg;
+  size_t start = i == 0 ? c->instart : c->splitpoints[i - 1];
+  size_t end = i == c->npoints ? c->inend : c->splitpoints[i];
+  ZopfliBlockState s;
+  ZopfliInitBlockState(c->options, start, end, 1, &s);
+  if (c->options->warmstart) {
+    ZopfliLZ77Store initial;
+    ZopfliAcquireLZ77Store(c->options, c->in, &initial);
+    ZopfliGetWarmStartRange(c->options->warmstart, start, end, &initial);
+    ZopfliLZ77OptimalFrom(&s, c->in, start, end, c->options->numiterations,
+                          &initial, &c->stores[i]);
+    ZopfliReleaseLZ77Store(c->options, &initial);
+  } else {
+    ZopfliLZ77Optimal(&s, c->in, start, end, c->options->numiterations,
+                      &c->stores[i]);
+  }
+  ZopfliCleanBlockState(&s);
+}
+
+/*
+Does all the expensive work of ZopfliDeflatePart for dynamic blocks, without
+writing any output: finds the block split points and the optimal LZ77 data of
+each block.
+lz77: initialized store that receives the LZ77 data of the whole part
+splitpoints: dynamic array receiving the block boundaries as LZ77 indices
+npoints: amount of splitpoints
+*/
+static void OptimizePart(const ZopfliOptions* options,
+                         const unsigned char* in, size_t instart, size_t inend,
+                         ZopfliLZ77Store* lz77,
+                         size_t** splitpoints, size_t* npoints) {
+  size_t i;
+  /* byte coordinates rather than lz77 index */
+  size_t* splitpoints_uncompressed = 0;
+  double totalcost = 0;
+  ZopfliLZ77Store* stores;
+  OptimizeBlocksContext c;
+
+  *splitpoints = 0;
+  *npoints = 0;
+
+  if (options->warmstart && options->blocksplitting) {
+    /* Keep the blocks of the earlier compression that start in this part. */
+    const ZopfliWarmStart* ws = options->warmstart;
+    for (i = 0; i < ws->npoints; i++) {
+      if (ws->splitpoints[i] > instart && ws->splitpoints[i] < inend) {
+        ZOPFLI_APPEND_DATA(ws->splitpoints[i], &splitpoints_uncompressed,
+                           npoints);
+      }
+    }
+    *splitpoints = (size_t*)malloc(sizeof(**splitpoints) * *npoints);
+  } else if (options->blocksplitting) {
+    ZopfliTrace(options, ZOPFLI_PHASE_SPLIT, 0, 0);
+    ZopfliBlockSplit(options, in, instart, inend,
+                     options->blocksplittingmax,
+                     &splitpoints_uncompressed, npoints);
+    ZopfliTrace(options, ZOPFLI_PHASE_SPLIT, 1, 0);
+    *splitpoints = (size_t*)malloc(sizeof(**splitpoints) * *npoints);
+  }
+
+  /* The blocks are independent, so they can be optimized in parallel. */
+  stores = (ZopfliLZ77Store*)malloc(sizeof(*stores) * (*npoints + 1));
+  if (!stores) exit(-1); /* Allocation failed. */
+  for (i = 0; i <= *npoints; i++) {
+    ZopfliAcquireLZ77Store(options, in, &stores[i]);
+  }
+
+  c.options = options;
+  c.in = in;
+  c.instart = instart;
+  c.inend = inend;
+  c.splitpoints = splitpoints_uncompressed;
+  c.npoints = *npoints;
+  c.stores = stores;
+  ZopfliRunJobs(options, *npoints + 1, OptimizeBlockJob, &c);
+
+  for (i = 0; i <= *npoints; i++) {
+    totalcost += ZopfliCalculateBlockSizeAutoType(&stores[i], 0,
+                                                  stores[i].size);
+
+    ZopfliAppendLZ77Store(&stores[i], lz77);
+    if (i < *npoints) (*splitpoints)[i] = lz77->size;
+
+    ZopfliReleaseLZ77Store(options, &stores[i]);
+  }
+  free(stores);
+
+  /* Second block splitting attempt. The blocks of a warm start were not
+  chosen for this LZ77 data, so always try it then. */
+  if (options->blocksplitting && (*npoints > 1 || options->warmstart)) {
+    size_t* splitpoints2 = 0;
+    size_t npoints2 = 0;
+    double totalcost2 = 0;
+
+    ZopfliTrace(options, ZOPFLI_PHASE_SPLIT, 0, 0);
+    ZopfliBlockSplitLZ77(options, lz77,
+                         options->blocksplittingmax, &splitpoints2, &npoints2);
+
+    for (i = 0; i <= npoints2; i++) {
+      size_t start = i == 0 ? 0 : splitpoints2[i - 1];
+      size_t end = i == npoints2 ? lz77->size : splitpoints2[i];
+      totalcost2 += ZopfliCalculateBlockSizeAutoType(lz77, start, end);
+    }
+
+    if (totalcost2 < totalcost) {
+      free(*splitpoints);
+      *splitpoints = splitpoints2;
+      *npoints = npoints2;
+    } else {
+      free(splitpoints2);
+    }
+    ZopfliTrace(options, ZOPFLI_PHASE_SPLIT, 1, 0);
+  }
+
+  free(splitpoints_uncompressed);
+}
+
+/*
+Writes the blocks found by OptimizePart to the output.
+*/
+static void WritePart(const ZopfliOptions* options, int final,
+                      const ZopfliLZ77Store* lz77,
+                      const size_t* splitpoints, size_t npoints,
+                      unsigned char* bp, unsigned char** out,
+                      size_t* outsize) {
+  size_t i;
+  ZopfliTrace(options, ZOPFLI_PHASE_ENCODE, 0, 0);
+  for (i = 0; i <= npoints; i++) {
+    size_t start = i == 0 ? 0 : splitpoints[i - 1];
+    size_t end = i == npoints ? lz77->size : splitpoints[i];
+    AddLZ77BlockAutoType(options, i == npoints && final,
+                         lz77, start, end, 0,
+                         bp, out, outsize);
+  }
+  ZopfliTrace(options, ZOPFLI_PHASE_ENCODE, 1, 0);
 }
 
 /*
@@ -812,12 +969,8 @@ void ZopfliDeflatePart(const ZopfliOptions* options, int btype, int final,
                        const unsigned char* in, size_t instart, size_t inend,
                        unsigned char* bp, unsigned char** out,
                        size_t* outsize) {
-  size_t i;
-  /* byte coordinates rather than lz77 index */
-  size_t* splitpoints_uncompressed = 0;
   size_t npoints = 0;
   size_t* splitpoints = 0;
-  double totalcost = 0;
   ZopfliLZ77Store lz77;
 
   /* If btype=2 is specified, it tries all block types. If a lesser btype is
@@ -829,7 +982,7 @@ void ZopfliDeflatePart(const ZopfliOptions* options, int btype, int final,
   } else if (btype == 1) {
     ZopfliLZ77Store store;
     ZopfliBlockState s;
-    ZopfliInitLZ77Store(in, &store);
+    ZopfliAcquireLZ77Store(options, in, &store);
     ZopfliInitBlockState(options, instart, inend, 1, &s);
 
     ZopfliLZ77OptimalFixed(&s, in, instart, inend, &store);
@@ -837,73 +990,78 @@ void ZopfliDeflatePart(const ZopfliOptions* options, int btype, int final,
                  bp, out, outsize);
 
     ZopfliCleanBlockState(&s);
-    ZopfliCleanLZ77Store(&store);
+    ZopfliReleaseLZ77Store(options, &store);
     return;
   }
 
+  ZopfliAcquireLZ77Store(options, in, &lz77);
+  OptimizePart(options, in, instart, inend, &lz77, &splitpoints, &npoints);
+  WritePart(options, final, &lz77, splitpoints, npoints, bp, out, outsize);
 
-  if (options->blocksplitting) {
-    ZopfliBlockSplit(options, in, instart, inend,
-                     options->blocksplittingmax,
-                     &splitpoints_uncompressed, &npoints);
-    splitpoints = (size_t*)malloc(sizeof(*splitpoints) * npoints);
-  }
-
-  ZopfliInitLZ77Store(in, &lz77);
+  ZopfliReleaseLZ77Store(options, &lz77);
+  free(splitpoints);
+}
 
-  for (i = 0; i <= npoints; i++) {
-    size_t start = i == 0 ? instart : splitpoints_uncompressed[i - 1];
-    size_t end = i == npoints ? inend : splitpoints_uncompressed[i];
-    ZopfliBlockState s;
-    ZopfliLZ77Store store;
-    ZopfliInitLZ77Store(in, &store);
-    ZopfliInitBlockState(options, start, end, 1, &s);
-    ZopfliLZ77Optimal(&s, in, start, end, options->numiterations, &store);
-    totalcost += ZopfliCalculateBlockSizeAutoType(&store, 0, store.size);
+#if ZOPFLI_MASTER_BLOCK_SIZE != 0
+/* One master block of ZopfliDeflate, optimized by OptimizePartJob. */
+typedef struct MasterBlock {
+  const ZopfliOptions* options;
+  const unsigned char* in;
+  size_t instart;
+  size_t inend;
+  ZopfliLZ77Store lz77;
+  size_t* splitpoints;
+  size_t npoints;
+} MasterBlock;
 
-    ZopfliAppendLZ77Store(&store, &lz77);
-    if (i < npoints) splitpoints[i] = lz77.size;
+/*
+Optimizes one master block, the output is written afterwards because every
+block depends on the bit position where the previous one ended.
+type: ZopfliJobFun
+*/
+static void OptimizePartJob(void* arg, size_t i) {
+  MasterBlock* m = &((MasterBlock*)arg)[i];
+  OptimizePart(m->options, m->in, m->instart, m->inend,
+               &m->lz77, &m->splitpoints, &m->npoints);
+}
 
-    ZopfliCleanBlockState(&s);
-    ZopfliCleanLZ77Store(&store);
+/*
+Like the sequential loop over ZopfliDeflatePart, but optimizes all master
+blocks of dynamic type with the job runner of the options first.
+*/
+static void DeflateMasterBlocksParallel(const ZopfliOptions* options,
+                                        int final,
+                                        const unsigned char* in, size_t insize,
+                                        unsigned char* bp, unsigned char** out,
+                                        size_t* outsize) {
+  size_t nblocks = (insize + ZOPFLI_MASTER_BLOCK_SIZE - 1)
+      / ZOPFLI_MASTER_BLOCK_SIZE;
+  MasterBlock* blocks = (MasterBlock*)malloc(sizeof(*blocks) * nblocks);
+  size_t i;
+  if (!blocks) exit(-1); /* Allocation failed. */
+
+  for (i = 0; i < nblocks; i++) {
+    blocks[i].options = options;
+    blocks[i].in = in;
+    blocks[i].instart = i * ZOPFLI_MASTER_BLOCK_SIZE;
+    blocks[i].inend = i + 1 == nblocks
+        ? insize : (i + 1) * ZOPFLI_MASTER_BLOCK_SIZE;
+    blocks[i].splitpoints = 0;
+    blocks[i].npoints = 0;
+    ZopfliAcquireLZ77Store(options, in, &blocks[i].lz77);
   }
 
-  /* Second block splitting attempt */
-  if (options->blocksplitting && npoints > 1) {
-    size_t* splitpoints2 = 0;
-    size_t npoints2 = 0;
-    double totalcost2 = 0;
+  ZopfliRunJobs(options, nblocks, OptimizePartJob, blocks);
 
-    ZopfliBlockSplitLZ77(options, &lz77,
-                         options->blocksplittingmax, &splitpoints2, &npoints2);
-
-    for (i = 0; i <= npoints2; i++) {
-      size_t start = i == 0 ? 0 : splitpoints2[i - 1];
-      size_t end = i == npoints2 ? lz77.size : splitpoints2[i];
-      totalcost2 += ZopfliCalculateBlockSizeAutoType(&lz77, start, end);
-    }
-
-    if (totalcost2 < totalcost) {
-      free(splitpoints);
-      splitpoints = splitpoints2;
-      npoints = npoints2;
-    } else {
-      free(splitpoints2);
-    }
+  for (i = 0; i < nblocks; i++) {
+    WritePart(options, final && i + 1 == nblocks, &blocks[i].lz77,
+              blocks[i].splitpoints, blocks[i].npoints, bp, out, outsize);
+    ZopfliReleaseLZ77Store(options, &blocks[i].lz77);
+    free(blocks[i].splitpoints);
   }
-
-  for (i = 0; i <= npoints; i++) {
-    size_t start = i == 0 ? 0 : splitpoints[i - 1];
-    size_t end = i == npoints ? lz77.size : splitpoints[i];
-    AddLZ77BlockAutoType(options, i == npoints && final,
-                         &lz77, start, end, 0,
-                         bp, out, outsize);
-  }
-
-  ZopfliCleanLZ77Store(&lz77);
-  free(splitpoints);
-  free(splitpoints_uncompressed);
+  free(blocks);
 }
+#endif
 
 void ZopfliDeflate(const ZopfliOptions* options, int btype, int final,
                    const unsigned char* in, size_t insize,
@@ -913,14 +1071,18 @@ void ZopfliDeflate(const ZopfliOptions* options, int btype, int final,
   ZopfliDeflatePart(options, btype, final, in, 0, insize, bp, out, outsize);
 #else
   size_t i = 0;
-  do {
-    int masterfinal = (i + ZOPFLI_MASTER_BLOCK_SIZE >= insize);
-    int final2 = final && masterfinal;
-    size_t size = masterfinal ? insize - i : ZOPFLI_MASTER_BLOCK_SIZE;
-    ZopfliDeflatePart(options, btype, final2,
-                      in, i, i + size, bp, out, outsize);
-    i += size;
-  } while (i < insize);
+  if (btype == 2 && options->runjobs && insize > ZOPFLI_MASTER_BLOCK_SIZE) {
+    DeflateMasterBlocksParallel(options, final, in, insize, bp, out, outsize);
+  } else {
+    do {
+      int masterfinal = (i + ZOPFLI_MASTER_BLOCK_SIZE >= insize);
+      int final2 = final && masterfinal;
+      size_t size = masterfinal ? insize - i : ZOPFLI_MASTER_BLOCK_SIZE;
+      ZopfliDeflatePart(options, btype, final2,
+                        in, i, i + size, bp, out, outsize);
+      i += size;
+    } while (i < insize);
+  }
 #endif
   if (options->verbose) {
     fprintf(stderr,
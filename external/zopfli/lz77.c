@@ -18,6 +18,7 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 */
 
 #include "lz77.h"
+#include "context.h"
 #include "symbols.h"
 #include "util.h"
 
@@ -25,8 +26,18 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 #include <stdio.h>
 #include <stdlib.h>
 
+#if defined(ZOPFLI_SIMD_MATCH) && (defined(__x86_64__) || defined(_M_X64)) && \
+    (defined(__GNUC__) || defined(_MSC_VER))
+#define ZOPFLI_HAVE_SIMD_MATCH
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 void ZopfliInitLZ77Store(const unsigned char* data, ZopfliLZ77Store* store) {
   store->size = 0;
+  store->capacity = 0;
   store->litlens = 0;
   store->dists = 0;
   store->pos = 0;
@@ -47,33 +58,53 @@ void ZopfliCleanLZ77Store(ZopfliLZ77Store* store) {
   free(store->d_counts);
 }
 
+void ZopfliResetLZ77Store(const unsigned char* data, ZopfliLZ77Store* store) {
+  store->size = 0;
+  store->data = data;
+}
+
 static size_t CeilDiv(size_t a, size_t b) {
   return (a + b - 1) / b;
 }
 
+/* Resizes all arrays of the store for capacity LZ77 symbols. */
+static void ReserveLZ77Store(size_t capacity, ZopfliLZ77Store* store) {
+  size_t llsize = ZOPFLI_NUM_LL * CeilDiv(capacity, ZOPFLI_NUM_LL);
+  size_t dsize = ZOPFLI_NUM_D * CeilDiv(capacity, ZOPFLI_NUM_D);
+  store->litlens = (unsigned short*)realloc(store->litlens,
+      sizeof(*store->litlens) * capacity);
+  store->dists = (unsigned short*)realloc(store->dists,
+      sizeof(*store->dists) * capacity);
+  store->pos = (size_t*)realloc(store->pos, sizeof(*store->pos) * capacity);
+  store->ll_symbol = (unsigned short*)realloc(store->ll_symbol,
+      sizeof(*store->ll_symbol) * capacity);
+  store->d_symbol = (unsigned short*)realloc(store->d_symbol,
+      sizeof(*store->d_symbol) * capacity);
+  store->ll_counts = (size_t*)realloc(store->ll_counts,
+      sizeof(*store->ll_counts) * llsize);
+  store->d_counts = (size_t*)realloc(store->d_counts,
+      sizeof(*store->d_counts) * dsize);
+
+  /* Allocation failed. */
+  if (!store->litlens || !store->dists) exit(-1);
+  if (!store->pos) exit(-1);
+  if (!store->ll_symbol || !store->d_symbol) exit(-1);
+  if (!store->ll_counts || !store->d_counts) exit(-1);
+
+  store->capacity = capacity;
+}
+
 void ZopfliCopyLZ77Store(
     const ZopfliLZ77Store* source, ZopfliLZ77Store* dest) {
   size_t i;
   size_t llsize = ZOPFLI_NUM_LL * CeilDiv(source->size, ZOPFLI_NUM_LL);
   size_t dsize = ZOPFLI_NUM_D * CeilDiv(source->size, ZOPFLI_NUM_D);
-  ZopfliCleanLZ77Store(dest);
-  ZopfliInitLZ77Store(source->data, dest);
-  dest->litlens =
-      (unsigned short*)malloc(sizeof(*dest->litlens) * source->size);
-  dest->dists = (unsigned short*)malloc(sizeof(*dest->dists) * source->size);
-  dest->pos = (size_t*)malloc(sizeof(*dest->pos) * source->size);
-  dest->ll_symbol =
-      (unsigned short*)malloc(sizeof(*dest->ll_symbol) * source->size);
-  dest->d_symbol =
-      (unsigned short*)malloc(sizeof(*dest->d_symbol) * source->size);
-  dest->ll_counts = (size_t*)malloc(sizeof(*dest->ll_counts) * llsize);
-  dest->d_counts = (size_t*)malloc(sizeof(*dest->d_counts) * dsize);
-
-  /* Allocation failed. */
-  if (!dest->litlens || !dest->dists) exit(-1);
-  if (!dest->pos) exit(-1);
-  if (!dest->ll_symbol || !dest->d_symbol) exit(-1);
-  if (!dest->ll_counts || !dest->d_counts) exit(-1);
+  ZopfliResetLZ77Store(source->data, dest);
+  if (dest->capacity < source->size) {
+    ZopfliCleanLZ77Store(dest);
+    ZopfliInitLZ77Store(source->data, dest);
+    ReserveLZ77Store(source->size, dest);
+  }
 
   dest->size = source->size;
   for (i = 0; i < source->size; i++) {
@@ -98,54 +129,48 @@ context must be a ZopfliLZ77Store*.
 void ZopfliStoreLitLenDist(unsigned short length, unsigned short dist,
                            size_t pos, ZopfliLZ77Store* store) {
   size_t i;
-  /* Needed for using ZOPFLI_APPEND_DATA multiple times. */
   size_t origsize = store->size;
   size_t llstart = ZOPFLI_NUM_LL * (origsize / ZOPFLI_NUM_LL);
   size_t dstart = ZOPFLI_NUM_D * (origsize / ZOPFLI_NUM_D);
 
+  /* Grow by doubling, a reset store keeps its memory for the next data. */
+  if (origsize == store->capacity) {
+    ReserveLZ77Store(origsize == 0 ? 1 : origsize * 2, store);
+  }
+
   /* Everytime the index wraps around, a new cumulative histogram is made: we're
   keeping one histogram value per LZ77 symbol rather than a full histogram for
   each to save memory. */
+
   if (origsize % ZOPFLI_NUM_LL == 0) {
-    size_t llsize = origsize;
     for (i = 0; i < ZOPFLI_NUM_LL; i++) {
-      ZOPFLI_APPEND_DATA(
-          origsize == 0 ? 0 : store->ll_counts[origsize - ZOPFLI_NUM_LL + i],
-          &store->ll_counts, &llsize);
+      store->ll_counts[origsize + i] = origsize == 0 ?
+          0 : store->ll_counts[origsize - ZOPFLI_NUM_LL + i];
     }
   }
   if (origsize % ZOPFLI_NUM_D == 0) {
-    size_t dsize = origsize;
     for (i = 0; i < ZOPFLI_NUM_D; i++) {
-      ZOPFLI_APPEND_DATA(
-          origsize == 0 ? 0 : store->d_counts[origsize - ZOPFLI_NUM_D + i],
-          &store->d_counts, &dsize);
+      store->d_counts[origsize + i] = origsize == 0 ?
+          0 : store->d_counts[origsize - ZOPFLI_NUM_D + i];
     }
   }
 
-  ZOPFLI_APPEND_DATA(length, &store->litlens, &store->size);
-  store->size = origsize;
-  ZOPFLI_APPEND_DATA(dist, &store->dists, &store->size);
-  store->size = origsize;
-  ZOPFLI_APPEND_DATA(pos, &store->pos, &store->size);
+  store->litlens[origsize] = length;
+  store->dists[origsize] = dist;
+  store->pos[origsize] = pos;
   assert(length < 259);
 
   if (dist == 0) {
-    store->size = origsize;
-    ZOPFLI_APPEND_DATA(length, &store->ll_symbol, &store->size);
-    store->size = origsize;
-    ZOPFLI_APPEND_DATA(0, &store->d_symbol, &store->size);
+    store->ll_symbol[origsize] = length;
+    store->d_symbol[origsize] = 0;
     store->ll_counts[llstart + length]++;
   } else {
-    store->size = origsize;
-    ZOPFLI_APPEND_DATA(ZopfliGetLengthSymbol(length),
-                       &store->ll_symbol, &store->size);
-    store->size = origsize;
-    ZOPFLI_APPEND_DATA(ZopfliGetDistSymbol(dist),
-                       &store->d_symbol, &store->size);
+    store->ll_symbol[origsize] = ZopfliGetLengthSymbol(length);
+    store->d_symbol[origsize] = ZopfliGetDistSymbol(dist);
     store->ll_counts[llstart + ZopfliGetLengthSymbol(length)]++;
     store->d_counts[dstart + ZopfliGetDistSymbol(dist)]++;
   }
+  store->size = origsize + 1;
 }
 
 void ZopfliAppendLZ77Store(const ZopfliLZ77Store* store,
@@ -216,16 +241,32 @@ void ZopfliLZ77GetHistogram(const ZopfliLZ77Store* lz77,
   }
 }
 
+static ZopfliGetMatchFun* SelectGetMatch(const ZopfliOptions* options);
+
 void ZopfliInitBlockState(const ZopfliOptions* options,
                           size_t blockstart, size_t blockend, int add_lmc,
                           ZopfliBlockState* s) {
+#ifdef ZOPFLI_LONGEST_MATCH_CACHE
+  int cachelength = add_lmc ? ZopfliCacheLengthForSize(
+      blockend - blockstart, options->maxcachesize) : -1;
+#endif
   s->options = options;
   s->blockstart = blockstart;
   s->blockend = blockend;
+  s->getmatch = SelectGetMatch(options);
 #ifdef ZOPFLI_LONGEST_MATCH_CACHE
-  if (add_lmc) {
+  if (cachelength >= 0) {
+    size_t blocksize = blockend - blockstart;
     s->lmc = (ZopfliLongestMatchCache*)malloc(sizeof(ZopfliLongestMatchCache));
-    ZopfliInitCache(blockend - blockstart, s->lmc);
+    if (!s->lmc) exit(-1); /* Allocation failed. */
+    s->lmc->cachelength = (size_t)cachelength;
+    s->lmc->length = (unsigned short*)ZopfliAcquireBuffer(options,
+        sizeof(*s->lmc->length) * blocksize);
+    s->lmc->dist = (unsigned short*)ZopfliAcquireBuffer(options,
+        sizeof(*s->lmc->dist) * blocksize);
+    s->lmc->sublen = (unsigned char*)ZopfliAcquireBuffer(options,
+        (size_t)cachelength * 3 * blocksize + 1);
+    ZopfliResetCache(blocksize, s->lmc);
   } else {
     s->lmc = 0;
   }
@@ -235,7 +276,9 @@ void ZopfliInitBlockState(const ZopfliOptions* options,
 void ZopfliCleanBlockState(ZopfliBlockState* s) {
 #ifdef ZOPFLI_LONGEST_MATCH_CACHE
   if (s->lmc) {
-    ZopfliCleanCache(s->lmc);
+    ZopfliReleaseBuffer(s->options, s->lmc->length);
+    ZopfliReleaseBuffer(s->options, s->lmc->dist);
+    ZopfliReleaseBuffer(s->options, s->lmc->sublen);
     free(s->lmc);
   }
 #endif
@@ -330,6 +373,96 @@ static const unsigned char* GetMatch(const unsigned char* scan,
   return scan;
 }
 
+#ifdef ZOPFLI_HAVE_SIMD_MATCH
+
+/* Index of the lowest set bit, mask must not be 0. */
+static unsigned CountTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+/* GetMatch comparing 16 bytes at once. SSE2 is part of every x86-64 CPU. */
+static const unsigned char* GetMatchSSE2(const unsigned char* scan,
+                                         const unsigned char* match,
+                                         const unsigned char* end,
+                                         const unsigned char* safe_end) {
+  while (end - scan >= 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)scan);
+    __m128i b = _mm_loadu_si128((const __m128i*)match);
+    unsigned diff = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) ^ 0xFFFFu;
+    if (diff) return scan + CountTrailingZeros(diff);
+    scan += 16;
+    match += 16;
+  }
+  return GetMatch(scan, match, end, safe_end);
+}
+
+/* GetMatch comparing 32 bytes at once, only used if the CPU has AVX2. */
+#ifdef __GNUC__
+__attribute__((target("avx2")))
+#endif
+static const unsigned char* GetMatchAVX2(const unsigned char* scan,
+                                         const unsigned char* match,
+                                         const unsigned char* end,
+                                         const unsigned char* safe_end) {
+  while (end - scan >= 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)scan);
+    __m256i b = _mm256_loadu_si256((const __m256i*)match);
+    unsigned diff = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    if (diff) return scan + CountTrailingZeros(diff);
+    scan += 32;
+    match += 32;
+  }
+  return GetMatchSSE2(scan, match, end, safe_end);
+}
+
+/* Whether the CPU and the operating system support AVX2. */
+static int HasAVX2(void) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return 0;
+  __cpuid(info, 1);
+  /* OSXSAVE and AVX, then the OS must save the YMM registers. */
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return 0;
+  if ((_xgetbv(0) & 6) != 6) return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+/*
+The SIMD variant for this CPU, detected on first use. Threads that detect it at
+the same time all store the same pointer.
+*/
+static ZopfliGetMatchFun* simdgetmatch = 0;
+
+#endif  /* ZOPFLI_HAVE_SIMD_MATCH */
+
+/* Picks the fastest GetMatch variant the CPU supports and the options allow. */
+static ZopfliGetMatchFun* SelectGetMatch(const ZopfliOptions* options) {
+#ifdef ZOPFLI_HAVE_SIMD_MATCH
+  ZopfliGetMatchFun* getmatch = simdgetmatch;
+  if (options->scalarmatch) return GetMatch;
+  if (!getmatch) {
+    getmatch = HasAVX2() ? GetMatchAVX2 : GetMatchSSE2;
+    simdgetmatch = getmatch;
+  }
+  return getmatch;
+#else
+  (void)options;
+  return GetMatch;
+#endif
+}
+
 #ifdef ZOPFLI_LONGEST_MATCH_CACHE
 /*
 Gets distance, length and sublen values from the cache if possible.
@@ -415,9 +548,10 @@ void ZopfliFindLongestMatch(ZopfliBlockState* s, const ZopfliHash* h,
   const unsigned char* match;
   const unsigned char* arrayend;
   const unsigned char* arrayend_safe;
-#if ZOPFLI_MAX_CHAIN_HITS < ZOPFLI_WINDOW_SIZE
-  int chain_counter = ZOPFLI_MAX_CHAIN_HITS;  /* For quitting early. */
-#endif
+  /* For quitting early. */
+  int chain_counter = s->options->maxchainhits > 0 &&
+      s->options->maxchainhits < ZOPFLI_MAX_CHAIN_HITS ?
+      s->options->maxchainhits : ZOPFLI_MAX_CHAIN_HITS;
 
   unsigned dist = 0;  /* Not unsigned short on purpose. */
 
@@ -488,7 +622,7 @@ void ZopfliFindLongestMatch(ZopfliBlockState* s, const ZopfliHash* h,
           match += same;
         }
 #endif
-        scan = GetMatch(scan, match, arrayend, arrayend_safe);
+        scan = s->getmatch(scan, match, arrayend, arrayend_safe);
         currentlength = scan - &array[pos];  /* The found length. */
       }
 
@@ -524,10 +658,40 @@ void ZopfliFindLongestMatch(ZopfliBlockState* s, const ZopfliHash* h,
 
     dist += p < pp ? pp - p : ((ZOPFLI_WINDOW_SIZE - p) + pp);
 
-#if ZOPFLI_MAX_CHAIN_HITS < ZOPFLI_WINDOW_SIZE
     chain_counter--;
     if (chain_counter <= 0) break;
-#endif
+  }
+
+  /* The chain walk stopped before it went through the whole window. The rows
+  above are likely matches in a raster image, try those it did not reach. Their
+  distance is larger than all tried so far, so sublen still gets the smallest
+  distance for every length. */
+  if (chain_counter <= 0 && s->options->rowwidth > 0 && bestlength < limit) {
+    size_t k;
+    for (k = 1; k <= ZOPFLI_ROW_CANDIDATES; k++) {
+      size_t rowdist = k * (size_t)s->options->rowwidth;
+      unsigned short currentlength;
+      if (rowdist >= ZOPFLI_WINDOW_SIZE || rowdist > pos) break;
+      if (rowdist < dist) continue;
+
+      scan = &array[pos];
+      match = &array[pos - rowdist];
+      if (*(scan + bestlength) != *(match + bestlength)) continue;
+      scan = s->getmatch(scan, match, arrayend, arrayend_safe);
+      currentlength = scan - &array[pos];
+
+      if (currentlength > bestlength && currentlength >= ZOPFLI_MIN_MATCH) {
+        if (sublen) {
+          unsigned short j;
+          for (j = bestlength + 1; j <= currentlength; j++) {
+            sublen[j] = rowdist;
+          }
+        }
+        bestdist = rowdist;
+        bestlength = currentlength;
+        if (currentlength >= limit) break;
+      }
+    }
   }
 
 #ifdef ZOPFLI_LONGEST_MATCH_CACHE
@@ -46,6 +46,8 @@ typedef struct ZopfliLZ77Store {
   unsigned short* dists;  /* If 0: indicates literal in corresponding litlens,
       if > 0: length in corresponding litlens, this is the distance. */
   size_t size;
+  /* Allocated length of the arrays with one value per LZ77 symbol. */
+  size_t capacity;
 
   const unsigned char* data;  /* original data */
   size_t* pos;  /* position in data where this LZ77 command begins */
@@ -63,6 +65,8 @@ typedef struct ZopfliLZ77Store {
 
 void ZopfliInitLZ77Store(const unsigned char* data, ZopfliLZ77Store* store);
 void ZopfliCleanLZ77Store(ZopfliLZ77Store* store);
+/* Empties the store for new data, but keeps its memory. */
+void ZopfliResetLZ77Store(const unsigned char* data, ZopfliLZ77Store* store);
 void ZopfliCopyLZ77Store(const ZopfliLZ77Store* source, ZopfliLZ77Store* dest);
 void ZopfliStoreLitLenDist(unsigned short length, unsigned short dist,
                            size_t pos, ZopfliLZ77Store* store);
@@ -78,6 +82,16 @@ void ZopfliLZ77GetHistogram(const ZopfliLZ77Store* lz77,
                             size_t lstart, size_t lend,
                             size_t* ll_counts, size_t* d_counts);
 
+/*
+Measures how many bytes at scan equal those at match, up to end. safe_end is a
+few (8) bytes before end. Returns the first byte after scan that differs, or
+end.
+*/
+typedef const unsigned char* ZopfliGetMatchFun(const unsigned char* scan,
+                                              const unsigned char* match,
+                                              const unsigned char* end,
+                                              const unsigned char* safe_end);
+
 /*
 Some state information for compressing a block.
 This is currently a bit under-used (with mainly only the longest match cache),
@@ -94,6 +108,9 @@ typedef struct ZopfliBlockState {
   /* The start (inclusive) and end (not inclusive) of the current block. */
   size_t blockstart;
   size_t blockend;
+
+  /* Match length comparison for this CPU. */
+  ZopfliGetMatchFun* getmatch;
 } ZopfliBlockState;
 
 void ZopfliInitBlockState(const ZopfliOptions* options,
@@ -24,6 +24,7 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 #include <stdio.h>
 
 #include "blocksplitter.h"
+#include "context.h"
 #include "deflate.h"
 #include "symbols.h"
 #include "tree.h"
@@ -308,6 +309,169 @@ static double GetBestLengths(ZopfliBlockState *s,
   return result;
 }
 
+/* Fixed point costs are in units of 1/ZOPFLI_COST_SCALE bit. */
+#define ZOPFLI_COST_SCALE 64
+
+/* Marks a position in the fixed point costs array as not reached yet. */
+#define ZOPFLI_COST_UNREACHED 0xFFFFFFFFu
+
+/*
+The cost model of GetCostStat as fixed point tables, built once per iteration.
+The cost of a length/distance pair is lengths[length] + dists[dist symbol].
+*/
+typedef struct FixedCostTable {
+  unsigned literals[256];
+  /* Symbol and extra bits of each length. */
+  unsigned lengths[ZOPFLI_MAX_MATCH + 1];
+  /* Symbol and extra bits of each distance symbol. */
+  unsigned dists[ZOPFLI_NUM_D];
+  /* Lowest possible cost of a length/distance pair. */
+  unsigned mincost;
+  /* Highest cost of a single literal or length/distance pair. */
+  unsigned maxcost;
+} FixedCostTable;
+
+static unsigned ToFixedCost(double bits) {
+  return (unsigned)(bits * ZOPFLI_COST_SCALE + 0.5);
+}
+
+static void InitFixedCostTable(const SymbolStats* stats, FixedCostTable* t) {
+  /* First distance of each distance symbol, see GetCostModelMinCost. */
+  static const int dsymbols[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+    769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+  };
+  unsigned minlength = ZOPFLI_COST_UNREACHED;
+  unsigned mindist = ZOPFLI_COST_UNREACHED;
+  unsigned maxlength = 0;
+  unsigned maxdist = 0;
+  int i;
+
+  t->maxcost = 0;
+  for (i = 0; i < 256; i++) {
+    t->literals[i] = ToFixedCost(stats->ll_symbols[i]);
+    if (t->literals[i] > t->maxcost) t->maxcost = t->literals[i];
+  }
+  t->lengths[0] = t->lengths[1] = t->lengths[2] = 0;
+  for (i = 3; i <= ZOPFLI_MAX_MATCH; i++) {
+    t->lengths[i] = ToFixedCost(ZopfliGetLengthExtraBits(i)
+        + stats->ll_symbols[ZopfliGetLengthSymbol(i)]);
+    if (t->lengths[i] < minlength) minlength = t->lengths[i];
+    if (t->lengths[i] > maxlength) maxlength = t->lengths[i];
+  }
+  for (i = 0; i < ZOPFLI_NUM_D; i++) {
+    /* Symbols 30 and 31 do not occur. */
+    t->dists[i] = i < 30 ? ToFixedCost(ZopfliGetDistExtraBits(dsymbols[i])
+        + stats->d_symbols[i]) : 0;
+    if (i < 30 && t->dists[i] < mindist) mindist = t->dists[i];
+    if (t->dists[i] > maxdist) maxdist = t->dists[i];
+  }
+  t->mincost = minlength + mindist;
+  if (maxlength + maxdist > t->maxcost) t->maxcost = maxlength + maxdist;
+}
+
+/*
+GetBestLengths with the costs of GetCostStat in fixed point: the cost model is
+turned into tables once, so the inner loop only does table lookups and integer
+additions. Rounding the symbol costs to 1/ZOPFLI_COST_SCALE bit can make ties
+break differently than with double costs, so the path can differ slightly.
+Returns 0 without doing anything if the costs of the block could overflow.
+*/
+static int GetBestLengthsFixedPoint(ZopfliBlockState *s,
+                                    const unsigned char* in,
+                                    size_t instart, size_t inend,
+                                    const SymbolStats* stats,
+                                    unsigned short* length_array,
+                                    ZopfliHash* h, unsigned* costs,
+                                    double* result) {
+  size_t blocksize = inend - instart;
+  size_t i = 0, k, kend;
+  unsigned short leng;
+  unsigned short dist;
+  unsigned short sublen[259];
+  size_t windowstart = instart > ZOPFLI_WINDOW_SIZE
+      ? instart - ZOPFLI_WINDOW_SIZE : 0;
+  FixedCostTable t;
+  unsigned mincostaddcostj;
+
+  InitFixedCostTable(stats, &t);
+  if (t.maxcost != 0 &&
+      blocksize >= (ZOPFLI_COST_UNREACHED - 1) / t.maxcost) {
+    return 0;
+  }
+
+  *result = 0;
+  if (instart == inend) return 1;
+
+  ZopfliResetHash(ZOPFLI_WINDOW_SIZE, h);
+  ZopfliWarmupHash(in, windowstart, inend, h);
+  for (i = windowstart; i < instart; i++) {
+    ZopfliUpdateHash(in, i, inend, h);
+  }
+
+  for (i = 1; i < blocksize + 1; i++) costs[i] = ZOPFLI_COST_UNREACHED;
+  costs[0] = 0;  /* Because it's the start. */
+  length_array[0] = 0;
+
+  for (i = instart; i < inend; i++) {
+    size_t j = i - instart;  /* Index in the costs array and length_array. */
+    const unsigned* dists = t.dists;
+    unsigned costj;
+    ZopfliUpdateHash(in, i, inend, h);
+
+#ifdef ZOPFLI_SHORTCUT_LONG_REPETITIONS
+    /* See GetBestLengths. */
+    if (h->same[i & ZOPFLI_WINDOW_MASK] > ZOPFLI_MAX_MATCH * 2
+        && i > instart + ZOPFLI_MAX_MATCH + 1
+        && i + ZOPFLI_MAX_MATCH * 2 + 1 < inend
+        && h->same[(i - ZOPFLI_MAX_MATCH) & ZOPFLI_WINDOW_MASK]
+            > ZOPFLI_MAX_MATCH) {
+      unsigned symbolcost = t.lengths[ZOPFLI_MAX_MATCH] + t.dists[0];
+      for (k = 0; k < ZOPFLI_MAX_MATCH; k++) {
+        costs[j + ZOPFLI_MAX_MATCH] = costs[j] + symbolcost;
+        length_array[j + ZOPFLI_MAX_MATCH] = ZOPFLI_MAX_MATCH;
+        i++;
+        j++;
+        ZopfliUpdateHash(in, i, inend, h);
+      }
+    }
+#endif
+
+    ZopfliFindLongestMatch(s, h, in, i, inend, ZOPFLI_MAX_MATCH, sublen,
+                           &dist, &leng);
+
+    /* Adding to an unreached cost would overflow, and cannot improve. */
+    costj = costs[j];
+    if (costj == ZOPFLI_COST_UNREACHED) continue;
+
+    /* Literal. */
+    if (i + 1 <= inend) {
+      unsigned newCost = t.literals[in[i]] + costj;
+      if (newCost < costs[j + 1]) {
+        costs[j + 1] = newCost;
+        length_array[j + 1] = 1;
+      }
+    }
+    /* Lengths. */
+    kend = zopfli_min(leng, inend-i);
+    mincostaddcostj = t.mincost + costj;
+    for (k = 3; k <= kend; k++) {
+      unsigned newCost;
+      if (costs[j + k] <= mincostaddcostj) continue;
+
+      newCost = t.lengths[k] + dists[ZopfliGetDistSymbol(sublen[k])] + costj;
+      if (newCost < costs[j + k]) {
+        assert(k <= ZOPFLI_MAX_MATCH);
+        costs[j + k] = newCost;
+        length_array[j + k] = k;
+      }
+    }
+  }
+
+  *result = (double)costs[blocksize] / ZOPFLI_COST_SCALE;
+  return 1;
+}
+
 /*
 Calculates the optimal path of lz77 lengths to use, from the calculated
 length_array. The length_array must contain the optimal length to reach that
@@ -315,11 +479,12 @@ byte. The path will be filled with the lengths to use, so its data size will be
 the amount of lz77 symbols.
 */
 static void TraceBackwards(size_t size, const unsigned short* length_array,
-                           unsigned short** path, size_t* pathsize) {
+                           unsigned short* path, size_t* pathsize) {
   size_t index = size;
+  *pathsize = 0;
   if (size == 0) return;
   for (;;) {
-    ZOPFLI_APPEND_DATA(length_array[index], path, pathsize);
+    path[(*pathsize)++] = length_array[index];
     assert(length_array[index] <= index);
     assert(length_array[index] <= ZOPFLI_MAX_MATCH);
     assert(length_array[index] != 0);
@@ -329,9 +494,9 @@ static void TraceBackwards(size_t size, const unsigned short* length_array,
 
   /* Mirror result. */
   for (index = 0; index < *pathsize / 2; index++) {
-    unsigned short temp = (*path)[index];
-    (*path)[index] = (*path)[*pathsize - index - 1];
-    (*path)[*pathsize - index - 1] = temp;
+    unsigned short temp = path[index];
+    path[index] = path[*pathsize - index - 1];
+    path[*pathsize - index - 1] = temp;
   }
 }
 
@@ -417,112 +582,312 @@ s: the block state
 in: the input data array
 instart: where to start
 inend: where to stop (not inclusive)
-path: pointer to dynamically allocated memory to store the path
-pathsize: pointer to the size of the dynamic path array
+path: array of size (inend - instart) that receives the path
+pathsize: receives the length of the path
 length_array: array of size (inend - instart) used to store lengths
 costmodel: function to use as the cost model for this squeeze run
 costcontext: abstract context for the costmodel function
 store: place to output the LZ77 data
+fixedcosts: if not NULL and the cost model is GetCostStat, array of size
+    (inend - instart + 1) for the fixed point costs, used instead of costs
 returns the cost that was, according to the costmodel, needed to get to the end.
     This is not the actual cost.
 */
 static double LZ77OptimalRun(ZopfliBlockState* s,
     const unsigned char* in, size_t instart, size_t inend,
-    unsigned short** path, size_t* pathsize,
+    unsigned short* path, size_t* pathsize,
     unsigned short* length_array, CostModelFun* costmodel,
     void* costcontext, ZopfliLZ77Store* store,
-    ZopfliHash* h, float* costs) {
-  double cost = GetBestLengths(s, in, instart, inend, costmodel,
-                costcontext, length_array, h, costs);
-  free(*path);
-  *path = 0;
-  *pathsize = 0;
+    ZopfliHash* h, float* costs, unsigned* fixedcosts) {
+  double cost;
+  if (!fixedcosts || costmodel != GetCostStat ||
+      !GetBestLengthsFixedPoint(s, in, instart, inend,
+                                (const SymbolStats*)costcontext, length_array,
+                                h, fixedcosts, &cost)) {
+    cost = GetBestLengths(s, in, instart, inend, costmodel,
+                          costcontext, length_array, h, costs);
+  }
   TraceBackwards(inend - instart, length_array, path, pathsize);
-  FollowPath(s, in, instart, inend, *path, *pathsize, store, h);
+  FollowPath(s, in, instart, inend, path, *pathsize, store, h);
   assert(cost < ZOPFLI_LARGE_FLOAT);
   return cost;
 }
 
+/*
+One sequence of squeeze iterations of ZopfliLZ77Optimal. Every sequence has its
+own random state and scratch memory, so that several of them with different
+seeds can run concurrently on the same block.
+*/
+typedef struct SqueezeRun {
+  SymbolStats stats;
+  SymbolStats beststats;
+  SymbolStats laststats;
+  double bestcost;
+  double lastcost;
+  /* Iteration that last lowered bestcost. */
+  int bestiteration;
+  /* Try randomizing the costs a bit once the size stabilizes. */
+  RanState ran_state;
+  int lastrandomstep;
+  int seed;
+  /* Amount of iterations that ran. */
+  int iterations;
+
+  /* Receives the best LZ77 data of this run. Points to ownstore, or to the
+  output of ZopfliLZ77Optimal for the first run. */
+  ZopfliLZ77Store* beststore;
+  ZopfliLZ77Store ownstore;
+
+  ZopfliLZ77Store currentstore;
+  ZopfliHash hash;
+  unsigned short* length_array;
+  unsigned short* path;
+  size_t pathsize;
+  float* costs;
+  /* Only allocated in fixed point mode. */
+  unsigned* fixedcosts;
+} SqueezeRun;
+
+static void InitSqueezeRun(const ZopfliOptions* options,
+                           const unsigned char* in, size_t blocksize, int seed,
+                           ZopfliLZ77Store* beststore, SqueezeRun* r) {
+  InitStats(&r->stats);
+  r->bestcost = ZOPFLI_LARGE_FLOAT;
+  r->lastcost = 0;
+  r->bestiteration = 0;
+  InitRanState(&r->ran_state);
+  /* Seed 0 is the sequence of the original single run. */
+  r->ran_state.m_w += seed;
+  r->ran_state.m_z += 65537 * seed;
+  r->lastrandomstep = -1;
+  r->seed = seed;
+  r->iterations = 0;
+
+  if (beststore) {
+    r->beststore = beststore;
+  } else {
+    ZopfliAcquireLZ77Store(options, in, &r->ownstore);
+    r->beststore = &r->ownstore;
+  }
+
+  ZopfliAcquireLZ77Store(options, in, &r->currentstore);
+  ZopfliAcquireHash(options, &r->hash);
+  r->length_array = (unsigned short*)ZopfliAcquireBuffer(options,
+      sizeof(unsigned short) * (blocksize + 1));
+  r->path = (unsigned short*)ZopfliAcquireBuffer(options,
+      sizeof(unsigned short) * (blocksize + 1));
+  r->pathsize = 0;
+  r->costs = (float*)ZopfliAcquireBuffer(options,
+      sizeof(float) * (blocksize + 1));
+  r->fixedcosts = 0;
+  if (options->fixedpointcosts) {
+    r->fixedcosts = (unsigned*)ZopfliAcquireBuffer(options,
+        sizeof(unsigned) * (blocksize + 1));
+  }
+}
+
+static void CleanSqueezeRun(const ZopfliOptions* options, SqueezeRun* r) {
+  ZopfliReleaseBuffer(options, r->length_array);
+  ZopfliReleaseBuffer(options, r->path);
+  ZopfliReleaseBuffer(options, r->costs);
+  ZopfliReleaseBuffer(options, r->fixedcosts);
+  if (r->beststore == &r->ownstore) {
+    ZopfliReleaseLZ77Store(options, &r->ownstore);
+  }
+  ZopfliReleaseLZ77Store(options, &r->currentstore);
+  ZopfliReleaseHash(options, &r->hash);
+}
+
+/*
+Does iteration i of ZopfliLZ77Optimal: a shortest path run with the cost model
+from the statistics of the previous iteration, then updates the statistics.
+*/
+static void SqueezeIteration(ZopfliBlockState* s, const unsigned char* in,
+                             size_t instart, size_t inend, int i,
+                             SqueezeRun* r) {
+  double cost;
+
+  r->iterations++;
+  ZopfliResetLZ77Store(in, &r->currentstore);
+  LZ77OptimalRun(s, in, instart, inend, r->path, &r->pathsize,
+                 r->length_array, GetCostStat, (void*)&r->stats,
+                 &r->currentstore, &r->hash, r->costs, r->fixedcosts);
+  cost = ZopfliCalculateBlockSize(&r->currentstore, 0, r->currentstore.size, 2);
+  if (s->options->verbose_more ||
+      (s->options->verbose && cost < r->bestcost)) {
+    if (r->seed == 0) {
+      fprintf(stderr, "Iteration %d: %d bit\n", i, (int) cost);
+    } else {
+      fprintf(stderr, "Seed %d iteration %d: %d bit\n",
+              r->seed, i, (int) cost);
+    }
+  }
+  if (cost < r->bestcost) {
+    /* Copy to the output store. */
+    ZopfliCopyLZ77Store(&r->currentstore, r->beststore);
+    CopyStats(&r->stats, &r->beststats);
+    r->bestcost = cost;
+    r->bestiteration = i;
+  }
+  CopyStats(&r->stats, &r->laststats);
+  ClearStatFreqs(&r->stats);
+  GetStatistics(&r->currentstore, &r->stats);
+  if (r->lastrandomstep != -1) {
+    /* This makes it converge slower but better. Do it only once the
+    randomness kicks in so that if the user does few iterations, it gives a
+    better result sooner. */
+    AddWeighedStatFreqs(&r->stats, 1.0, &r->laststats, 0.5, &r->stats);
+    CalculateStatistics(&r->stats);
+  }
+  if (i > 5 && cost == r->lastcost) {
+    CopyStats(&r->beststats, &r->stats);
+    RandomizeStatFreqs(&r->ran_state, &r->stats);
+    CalculateStatistics(&r->stats);
+    r->lastrandomstep = i;
+  }
+  r->lastcost = cost;
+}
+
+/*
+Returns whether the run should stop before iteration i, because its cost
+stalled or because the caller asks for it.
+*/
+static int StopIterations(const ZopfliBlockState* s, size_t inend, int i,
+                          const SqueezeRun* r) {
+  const ZopfliOptions* options = s->options;
+  if (options->numstalliterations > 0 &&
+      i - 1 - r->bestiteration >= options->numstalliterations) {
+    return 1;
+  }
+  return options->stop && options->stop(options->stop_context, inend);
+}
+
+/* Shared state of the SqueezeSeedJob jobs of one block. */
+typedef struct SqueezeSeedsContext {
+  ZopfliBlockState* s;
+  const unsigned char* in;
+  size_t instart;
+  size_t inend;
+  int numiterations;
+  SqueezeRun* runs;
+} SqueezeSeedsContext;
+
+/*
+Continues the iterations of one seeded run after the first iteration.
+type: ZopfliJobFun
+*/
+static void SqueezeSeedJob(void* arg, size_t index) {
+  const SqueezeSeedsContext* c = (const SqueezeSeedsContext*)arg;
+  int i;
+  for (i = 1; i < c->numiterations; i++) {
+    if (StopIterations(c->s, c->inend, i, &c->runs[index])) break;
+    SqueezeIteration(c->s, c->in, c->instart, c->inend, i, &c->runs[index]);
+  }
+}
+
 void ZopfliLZ77Optimal(ZopfliBlockState *s,
                        const unsigned char* in, size_t instart, size_t inend,
                        int numiterations,
                        ZopfliLZ77Store* store) {
+  ZopfliLZ77OptimalFrom(s, in, instart, inend, numiterations, 0, store);
+}
+
+void ZopfliLZ77OptimalFrom(ZopfliBlockState *s,
+                           const unsigned char* in,
+                           size_t instart, size_t inend,
+                           int numiterations,
+                           const ZopfliLZ77Store* initial,
+                           ZopfliLZ77Store* store) {
   /* Dist to get to here with smallest cost. */
   size_t blocksize = inend - instart;
-  unsigned short* length_array =
-      (unsigned short*)malloc(sizeof(unsigned short) * (blocksize + 1));
-  unsigned short* path = 0;
-  size_t pathsize = 0;
-  ZopfliLZ77Store currentstore;
-  ZopfliHash hash;
-  ZopfliHash* h = &hash;
-  SymbolStats stats, beststats, laststats;
+  int numseeds = s->options->numseeds > 1 ? s->options->numseeds : 1;
+  SqueezeRun* runs;
+  int iterations;
   int i;
-  float* costs = (float*)malloc(sizeof(float) * (blocksize + 1));
-  double cost;
-  double bestcost = ZOPFLI_LARGE_FLOAT;
-  double lastcost = 0;
-  /* Try randomizing the costs a bit once the size stabilizes. */
-  RanState ran_state;
-  int lastrandomstep = -1;
 
-  if (!costs) exit(-1); /* Allocation failed. */
-  if (!length_array) exit(-1); /* Allocation failed. */
+  ZopfliTrace(s->options, ZOPFLI_PHASE_LZ77, 0, 0);
+  if (numiterations < 2) numseeds = 1;
+  runs = (SqueezeRun*)malloc(sizeof(*runs) * numseeds);
+  if (!runs) exit(-1); /* Allocation failed. */
 
-  InitRanState(&ran_state);
-  InitStats(&stats);
-  ZopfliInitLZ77Store(in, &currentstore);
-  ZopfliAllocHash(ZOPFLI_WINDOW_SIZE, h);
+  InitSqueezeRun(s->options, in, blocksize, 0, store, &runs[0]);
 
   /* Do regular deflate, then loop multiple shortest path runs, each time using
   the statistics of the previous run. */
 
   /* Initial run. */
-  ZopfliLZ77Greedy(s, in, instart, inend, &currentstore, h);
-  GetStatistics(&currentstore, &stats);
-
-  /* Repeat statistics with each time the cost model from the previous stat
-  run. */
-  for (i = 0; i < numiterations; i++) {
-    ZopfliCleanLZ77Store(&currentstore);
-    ZopfliInitLZ77Store(in, &currentstore);
-    LZ77OptimalRun(s, in, instart, inend, &path, &pathsize,
-                   length_array, GetCostStat, (void*)&stats,
-                   &currentstore, h, costs);
-    cost = ZopfliCalculateBlockSize(&currentstore, 0, currentstore.size, 2);
-    if (s->options->verbose_more || (s->options->verbose && cost < bestcost)) {
-      fprintf(stderr, "Iteration %d: %d bit\n", i, (int) cost);
+  if (initial) {
+    /* The given solution is also the one to beat. */
+    ZopfliCopyLZ77Store(initial, &runs[0].currentstore);
+    ZopfliCopyLZ77Store(initial, runs[0].beststore);
+    runs[0].bestcost =
+        ZopfliCalculateBlockSize(initial, 0, initial->size, 2);
+  } else {
+    ZopfliLZ77Greedy(s, in, instart, inend, &runs[0].currentstore,
+                     &runs[0].hash);
+  }
+  GetStatistics(&runs[0].currentstore, &runs[0].stats);
+  if (initial) CopyStats(&runs[0].stats, &runs[0].beststats);
+
+  if (StopIterations(s, inend, 0, &runs[0])) {
+    /* Out of time before the first iteration, keep the initial result. */
+    ZopfliCopyLZ77Store(&runs[0].currentstore, store);
+  } else if (numseeds == 1) {
+    /* Repeat statistics with each time the cost model from the previous stat
+    run. */
+    for (i = 0; i < numiterations; i++) {
+      if (i > 0 && StopIterations(s, inend, i, &runs[0])) break;
+      SqueezeIteration(s, in, instart, inend, i, &runs[0]);
     }
-    if (cost < bestcost) {
-      /* Copy to the output store. */
-      ZopfliCopyLZ77Store(&currentstore, store);
-      CopyStats(&stats, &beststats);
-      bestcost = cost;
+  } else {
+    SqueezeSeedsContext c;
+    int best = 0;
+
+    /* The first iteration fills the longest match cache, after that the
+    cache is only read, so all seeds can share the block state. */
+    SqueezeIteration(s, in, instart, inend, 0, &runs[0]);
+
+    /* Every other seed starts from the same solution, but with randomized
+    statistics, so that the runs explore different paths right away. */
+    for (i = 1; i < numseeds; i++) {
+      SqueezeRun* r = &runs[i];
+      InitSqueezeRun(s->options, in, blocksize, i, 0, r);
+      CopyStats(&runs[0].stats, &r->stats);
+      CopyStats(&runs[0].beststats, &r->beststats);
+      CopyStats(&runs[0].laststats, &r->laststats);
+      r->bestcost = runs[0].bestcost;
+      r->lastcost = runs[0].lastcost;
+      ZopfliCopyLZ77Store(runs[0].beststore, r->beststore);
+      RandomizeStatFreqs(&r->ran_state, &r->stats);
+      CalculateStatistics(&r->stats);
+      r->lastrandomstep = 0;
+    }
+
+    c.s = s;
+    c.in = in;
+    c.instart = instart;
+    c.inend = inend;
+    c.numiterations = numiterations;
+    c.runs = runs;
+    ZopfliRunJobs(s->options, numseeds, SqueezeSeedJob, &c);
+
+    /* Keep the smallest result, the lowest seed wins ties. */
+    for (i = 1; i < numseeds; i++) {
+      if (runs[i].bestcost < runs[best].bestcost) best = i;
     }
-    CopyStats(&stats, &laststats);
-    ClearStatFreqs(&stats);
-    GetStatistics(&currentstore, &stats);
-    if (lastrandomstep != -1) {
-      /* This makes it converge slower but better. Do it only once the
-      randomness kicks in so that if the user does few iterations, it gives a
-      better result sooner. */
-      AddWeighedStatFreqs(&stats, 1.0, &laststats, 0.5, &stats);
-      CalculateStatistics(&stats);
+    if (best != 0) {
+      ZopfliCopyLZ77Store(runs[best].beststore, store);
     }
-    if (i > 5 && cost == lastcost) {
-      CopyStats(&beststats, &stats);
-      RandomizeStatFreqs(&ran_state, &stats);
-      CalculateStatistics(&stats);
-      lastrandomstep = i;
+    for (i = 1; i < numseeds; i++) {
+      runs[0].iterations += runs[i].iterations;
+      CleanSqueezeRun(s->options, &runs[i]);
     }
-    lastcost = cost;
   }
 
-  free(length_array);
-  free(path);
-  free(costs);
-  ZopfliCleanLZ77Store(&currentstore);
-  ZopfliCleanHash(h);
+  iterations = runs[0].iterations;
+  CleanSqueezeRun(s->options, &runs[0]);
+  free(runs);
+  ZopfliTrace(s->options, ZOPFLI_PHASE_LZ77, 1, iterations);
 }
 
 void ZopfliLZ77OptimalFixed(ZopfliBlockState *s,
@@ -531,30 +896,30 @@ void ZopfliLZ77OptimalFixed(ZopfliBlockState *s,
                             ZopfliLZ77Store* store)
 {
   /* Dist to get to here with smallest cost. */
+  const ZopfliOptions* options = s->options;
   size_t blocksize = inend - instart;
-  unsigned short* length_array =
-      (unsigned short*)malloc(sizeof(unsigned short) * (blocksize + 1));
-  unsigned short* path = 0;
+  unsigned short* length_array = (unsigned short*)ZopfliAcquireBuffer(options,
+      sizeof(unsigned short) * (blocksize + 1));
+  unsigned short* path = (unsigned short*)ZopfliAcquireBuffer(options,
+      sizeof(unsigned short) * (blocksize + 1));
   size_t pathsize = 0;
   ZopfliHash hash;
   ZopfliHash* h = &hash;
-  float* costs = (float*)malloc(sizeof(float) * (blocksize + 1));
-
-  if (!costs) exit(-1); /* Allocation failed. */
-  if (!length_array) exit(-1); /* Allocation failed. */
+  float* costs = (float*)ZopfliAcquireBuffer(options,
+      sizeof(float) * (blocksize + 1));
 
-  ZopfliAllocHash(ZOPFLI_WINDOW_SIZE, h);
+  ZopfliAcquireHash(options, h);
 
   s->blockstart = instart;
   s->blockend = inend;
 
   /* Shortest path for fixed tree This one should give the shortest possible
   result for fixed tree, no repeated runs are needed since the tree is known. */
-  LZ77OptimalRun(s, in, instart, inend, &path, &pathsize,
-                 length_array, GetCostFixed, 0, store, h, costs);
+  LZ77OptimalRun(s, in, instart, inend, path, &pathsize,
+                 length_array, GetCostFixed, 0, store, h, costs, 0);
 
-  free(length_array);
-  free(path);
-  free(costs);
-  ZopfliCleanHash(h);
+  ZopfliReleaseBuffer(options, length_array);
+  ZopfliReleaseBuffer(options, path);
+  ZopfliReleaseBuffer(options, costs);
+  ZopfliReleaseHash(options, h);
 }
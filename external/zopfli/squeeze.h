@@ -43,6 +43,19 @@ void ZopfliLZ77Optimal(ZopfliBlockState *s,
                        int numiterations,
                        ZopfliLZ77Store* store);
 
+/*
+Like ZopfliLZ77Optimal, but starts from the given LZ77 data of the block instead
+of a greedy parse. The initial data competes with the iterations, so the result
+never has a higher estimated cost than it.
+initial: LZ77 data of the bytes from instart to inend
+*/
+void ZopfliLZ77OptimalFrom(ZopfliBlockState *s,
+                           const unsigned char* in,
+                           size_t instart, size_t inend,
+                           int numiterations,
+                           const ZopfliLZ77Store* initial,
+                           ZopfliLZ77Store* store);
+
 /*
 Does the same as ZopfliLZ77Optimal, but optimized for the fixed tree of the
 deflate standard.
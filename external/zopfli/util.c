@@ -32,4 +32,38 @@ void ZopfliInitOptions(ZopfliOptions* options) {
   options->blocksplitting = 1;
   options->blocksplittinglast = 0;
   options->blocksplittingmax = 15;
+  options->numseeds = 1;
+  options->numstalliterations = 0;
+  options->stop = 0;
+  options->stop_context = 0;
+  options->maxcachesize = 0;
+  options->fixedpointcosts = 0;
+  options->rowwidth = 0;
+  options->maxchainhits = 0;
+  options->scalarmatch = 0;
+  options->warmstart = 0;
+  options->speculativesplit = 0;
+  options->runjobs = 0;
+  options->runjobs_context = 0;
+  options->getcontext = 0;
+  options->getcontext_context = 0;
+  options->trace = 0;
+  options->trace_context = 0;
+}
+
+void ZopfliRunJobs(const ZopfliOptions* options, size_t numjobs,
+                   ZopfliJobFun* job, void* arg) {
+  size_t i;
+  if (options->runjobs && numjobs > 1) {
+    options->runjobs(options->runjobs_context, numjobs, job, arg);
+    return;
+  }
+  for (i = 0; i < numjobs; i++) job(arg, i);
+}
+
+void ZopfliTrace(const ZopfliOptions* options, ZopfliPhase phase, int end,
+                 int iterations) {
+  if (options->trace) {
+    options->trace(options->trace_context, phase, end, iterations);
+  }
 }
@@ -83,6 +83,12 @@ Good value: e.g. 8192.
 */
 #define ZOPFLI_MAX_CHAIN_HITS 8192
 
+/*
+Number of rows above the current position that ZopfliFindLongestMatch tries
+when ZopfliOptions.rowwidth is set and the hash chain walk stopped early.
+*/
+#define ZOPFLI_ROW_CANDIDATES 32
+
 /*
 Whether to use the longest match cache for ZopfliFindLongestMatch. This cache
 consumes a lot of memory but speeds it up. No effect on compression size.
@@ -113,6 +119,14 @@ the compression result.
 */
 #define ZOPFLI_SHORTCUT_LONG_REPETITIONS
 
+/*
+Compare 16 (SSE2) or 32 (AVX2) bytes at once when measuring match lengths on
+x86-64, the variant is picked once at runtime from the CPU features and
+ZopfliOptions.scalarmatch turns it off. This has no effect on the compression
+result, only on speed.
+*/
+#define ZOPFLI_SIMD_MATCH
+
 /*
 Whether to use lazy matching in the greedy LZ77 implementation. This gives a
 better result of ZopfliLZ77Greedy, but the effect this has on the optimal LZ77
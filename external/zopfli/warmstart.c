@@ -0,0 +1,339 @@
+/*
+Copyright 2026 xyzcrush authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "warmstart.h"
+
+#include <assert.h>
+
+#include "util.h"
+
+/* Reads the bits of a deflate stream, least significant bit first. */
+typedef struct BitReader {
+  const unsigned char* data;
+  size_t size;
+  size_t bitpos;
+  int error;  /* Set when reading past the end. */
+} BitReader;
+
+static unsigned ReadBits(BitReader* br, int numbits) {
+  unsigned result = 0;
+  int i;
+  for (i = 0; i < numbits; i++) {
+    size_t byte = br->bitpos >> 3;
+    if (byte >= br->size) {
+      br->error = 1;
+      return 0;
+    }
+    result |= ((br->data[byte] >> (br->bitpos & 7)) & 1u) << i;
+    br->bitpos++;
+  }
+  return result;
+}
+
+/* Canonical Huffman code, as count of codes per length and sorted symbols. */
+typedef struct HuffmanDecoder {
+  unsigned short count[16];
+  unsigned short symbol[ZOPFLI_NUM_LL];
+} HuffmanDecoder;
+
+/*
+Builds the decoder for the code lengths of n symbols. Returns 0 when the lengths
+are oversubscribed. Incomplete codes are allowed, deflate uses them for a single
+distance code.
+*/
+static int BuildDecoder(const unsigned* lengths, int n, HuffmanDecoder* h) {
+  unsigned short offsets[16];
+  int left = 1;
+  int i;
+  for (i = 0; i < 16; i++) h->count[i] = 0;
+  for (i = 0; i < n; i++) h->count[lengths[i]]++;
+  for (i = 1; i < 16; i++) {
+    left <<= 1;
+    left -= h->count[i];
+    if (left < 0) return 0;
+  }
+  offsets[1] = 0;
+  for (i = 1; i < 15; i++) offsets[i + 1] = offsets[i] + h->count[i];
+  for (i = 0; i < n; i++) {
+    if (lengths[i] != 0) h->symbol[offsets[lengths[i]]++] = i;
+  }
+  return 1;
+}
+
+/* Decodes one symbol, returns -1 for an invalid code. */
+static int DecodeSymbol(BitReader* br, const HuffmanDecoder* h) {
+  int code = 0;  /* Bits read so far. */
+  int first = 0;  /* First code of the current length. */
+  int index = 0;  /* Index of that code in h->symbol. */
+  int len;
+  for (len = 1; len < 16; len++) {
+    code |= (int)ReadBits(br, 1);
+    if (br->error) return -1;
+    if (code - first < h->count[len]) return h->symbol[index + code - first];
+    index += h->count[len];
+    first += h->count[len];
+    first <<= 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+static const unsigned short kLengthBase[29] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const unsigned char kLengthExtra[29] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+  5, 5, 5, 5, 0
+};
+static const unsigned short kDistBase[30] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513,
+  769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const unsigned char kDistExtra[30] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10,
+  11, 11, 12, 12, 13, 13
+};
+
+/* Reads the code lengths of a dynamic block and builds both decoders. */
+static int ReadDynamicCodes(BitReader* br,
+                            HuffmanDecoder* ll, HuffmanDecoder* d) {
+  static const unsigned char order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+  };
+  unsigned lengths[ZOPFLI_NUM_LL + ZOPFLI_NUM_D];
+  HuffmanDecoder cl;
+  int hlit = (int)ReadBits(br, 5) + 257;
+  int hdist = (int)ReadBits(br, 5) + 1;
+  int hclen = (int)ReadBits(br, 4) + 4;
+  int i = 0;
+
+  if (hlit > 286 || hdist > 30) return 0;
+  for (i = 0; i < 19; i++) lengths[order[i]] = i < hclen ? ReadBits(br, 3) : 0;
+  if (br->error || !BuildDecoder(lengths, 19, &cl)) return 0;
+
+  i = 0;
+  while (i < hlit + hdist) {
+    int symbol = DecodeSymbol(br, &cl);
+    unsigned value = 0;
+    int repeat;
+    if (symbol < 0) return 0;
+    if (symbol < 16) {
+      lengths[i++] = symbol;
+      continue;
+    }
+    if (symbol == 16) {
+      if (i == 0) return 0;
+      value = lengths[i - 1];
+      repeat = 3 + (int)ReadBits(br, 2);
+    } else if (symbol == 17) {
+      repeat = 3 + (int)ReadBits(br, 3);
+    } else {
+      repeat = 11 + (int)ReadBits(br, 7);
+    }
+    if (br->error || i + repeat > hlit + hdist) return 0;
+    while (repeat--) lengths[i++] = value;
+  }
+
+  if (lengths[256] == 0) return 0;  /* No end code. */
+  return BuildDecoder(lengths, hlit, ll) &&
+         BuildDecoder(lengths + hlit, hdist, d);
+}
+
+static void InitFixedCodes(HuffmanDecoder* ll, HuffmanDecoder* d) {
+  unsigned lengths[ZOPFLI_NUM_LL];
+  int i;
+  for (i = 0; i < 144; i++) lengths[i] = 8;
+  for (; i < 256; i++) lengths[i] = 9;
+  for (; i < 280; i++) lengths[i] = 7;
+  for (; i < 288; i++) lengths[i] = 8;
+  BuildDecoder(lengths, ZOPFLI_NUM_LL, ll);
+  for (i = 0; i < ZOPFLI_NUM_D; i++) lengths[i] = 5;
+  BuildDecoder(lengths, ZOPFLI_NUM_D, d);
+}
+
+/*
+Decodes the symbols of a Huffman coded block into ws, checking that they
+produce the data at *pos.
+*/
+static int ReadCodedBlock(BitReader* br, const HuffmanDecoder* ll,
+                          const HuffmanDecoder* d,
+                          const unsigned char* in, size_t insize, size_t* pos,
+                          ZopfliWarmStart* ws) {
+  for (;;) {
+    int symbol = DecodeSymbol(br, ll);
+    unsigned length;
+    unsigned dist;
+    size_t i;
+    if (symbol < 0) return 0;
+    if (symbol == 256) return 1;
+    if (symbol < 256) {
+      if (*pos >= insize || in[*pos] != symbol) return 0;
+      ZopfliStoreLitLenDist(symbol, 0, *pos, &ws->lz77);
+      (*pos)++;
+      continue;
+    }
+
+    symbol -= 257;
+    if (symbol >= 29) return 0;
+    length = kLengthBase[symbol] + ReadBits(br, kLengthExtra[symbol]);
+    symbol = DecodeSymbol(br, d);
+    if (symbol < 0 || symbol >= 30) return 0;
+    dist = kDistBase[symbol] + ReadBits(br, kDistExtra[symbol]);
+    if (br->error || dist > *pos || length > insize - *pos) return 0;
+    for (i = 0; i < length; i++) {
+      if (in[*pos + i] != in[*pos + i - dist]) return 0;
+    }
+    ZopfliStoreLitLenDist(length, dist, *pos, &ws->lz77);
+    *pos += length;
+  }
+}
+
+/* Stores the bytes of an uncompressed block as literals. */
+static int ReadStoredBlock(BitReader* br,
+                           const unsigned char* in, size_t insize, size_t* pos,
+                           ZopfliWarmStart* ws) {
+  size_t byte = (br->bitpos + 7) >> 3;
+  unsigned len;
+  unsigned nlen;
+  unsigned i;
+  if (byte + 4 > br->size) return 0;
+  len = br->data[byte] | (br->data[byte + 1] << 8);
+  nlen = br->data[byte + 2] | (br->data[byte + 3] << 8);
+  byte += 4;
+  if (len != (~nlen & 65535u) || byte + len > br->size ||
+      len > insize - *pos) {
+    return 0;
+  }
+  for (i = 0; i < len; i++) {
+    if (br->data[byte + i] != in[*pos]) return 0;
+    ZopfliStoreLitLenDist(in[*pos], 0, *pos, &ws->lz77);
+    (*pos)++;
+  }
+  br->bitpos = (byte + len) * 8;
+  return 1;
+}
+
+/* Decodes all blocks of a raw deflate stream. */
+static int ReadDeflate(BitReader* br, const unsigned char* in, size_t insize,
+                       ZopfliWarmStart* ws) {
+  HuffmanDecoder ll;
+  HuffmanDecoder d;
+  size_t pos = 0;
+  int final = 0;
+  while (!final) {
+    unsigned btype;
+    int ok;
+    final = (int)ReadBits(br, 1);
+    btype = ReadBits(br, 2);
+    if (br->error) return 0;
+
+    /* Empty blocks and blocks at the start add no boundary. */
+    if (pos > 0 && pos < insize &&
+        (ws->npoints == 0 || ws->splitpoints[ws->npoints - 1] != pos)) {
+      ZOPFLI_APPEND_DATA(pos, &ws->splitpoints, &ws->npoints);
+    }
+
+    if (btype == 0) {
+      ok = ReadStoredBlock(br, in, insize, &pos, ws);
+    } else if (btype == 1) {
+      InitFixedCodes(&ll, &d);
+      ok = ReadCodedBlock(br, &ll, &d, in, insize, &pos, ws);
+    } else if (btype == 2) {
+      ok = ReadDynamicCodes(br, &ll, &d) &&
+           ReadCodedBlock(br, &ll, &d, in, insize, &pos, ws);
+    } else {
+      ok = 0;
+    }
+    if (!ok || br->error) return 0;
+  }
+
+  /* A split point at the very end would make an empty block. */
+  while (ws->npoints > 0 && ws->splitpoints[ws->npoints - 1] >= insize) {
+    ws->npoints--;
+  }
+  return pos == insize;
+}
+
+int ZopfliInitWarmStart(const unsigned char* zlib, size_t zlibsize,
+                        const unsigned char* in, size_t insize,
+                        ZopfliWarmStart* ws) {
+  BitReader br;
+  ZopfliInitLZ77Store(in, &ws->lz77);
+  ws->splitpoints = 0;
+  ws->npoints = 0;
+
+  /* Deflate method, no preset dictionary and a valid header check. */
+  if (zlibsize < 2 || (zlib[0] & 15) != 8 || (zlib[1] & 32) ||
+      ((zlib[0] << 8) | zlib[1]) % 31 != 0) {
+    return 0;
+  }
+
+  br.data = zlib + 2;
+  br.size = zlibsize - 2;
+  br.bitpos = 0;
+  br.error = 0;
+  if (!ReadDeflate(&br, in, insize, ws)) {
+    ZopfliCleanWarmStart(ws);
+    return 0;
+  }
+  return 1;
+}
+
+void ZopfliCleanWarmStart(ZopfliWarmStart* ws) {
+  ZopfliCleanLZ77Store(&ws->lz77);
+  free(ws->splitpoints);
+  ws->splitpoints = 0;
+  ws->npoints = 0;
+}
+
+/* Appends the bytes from start to end (not inclusive) as literals. */
+static void StoreLiterals(const unsigned char* in, size_t start, size_t end,
+                          ZopfliLZ77Store* store) {
+  size_t i;
+  for (i = start; i < end; i++) ZopfliStoreLitLenDist(in[i], 0, i, store);
+}
+
+void ZopfliGetWarmStartRange(const ZopfliWarmStart* ws,
+                             size_t instart, size_t inend,
+                             ZopfliLZ77Store* store) {
+  const ZopfliLZ77Store* lz77 = &ws->lz77;
+  size_t lo = 0;
+  size_t hi = lz77->size;
+  size_t i;
+
+  /* Find the last symbol that begins at or before instart. */
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (lz77->pos[mid] <= instart) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for (i = lo; i < lz77->size && lz77->pos[i] < inend; i++) {
+    size_t start = lz77->pos[i];
+    size_t length = lz77->dists[i] == 0 ? 1 : lz77->litlens[i];
+    if (start + length <= instart) continue;
+    if (start < instart || start + length > inend) {
+      StoreLiterals(lz77->data, start < instart ? instart : start,
+                    start + length > inend ? inend : start + length, store);
+    } else {
+      ZopfliStoreLitLenDist(lz77->litlens[i], lz77->dists[i], start, store);
+    }
+  }
+}
@@ -0,0 +1,74 @@
+/*
+Copyright 2026 xyzcrush authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Reads the LZ77 data and the block boundaries back out of an existing zlib
+stream, so that a new compression of the same data can start from it instead
+of from a greedy parse. See ZopfliOptions.warmstart.
+*/
+
+#ifndef ZOPFLI_WARMSTART_H_
+#define ZOPFLI_WARMSTART_H_
+
+#include <stdlib.h>
+
+#include "lz77.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ZopfliWarmStart {
+  /* LZ77 data of the whole input, as it was in the stream. */
+  ZopfliLZ77Store lz77;
+
+  /* Where the blocks of the stream start, as byte positions in the input. The
+  first block is not included. */
+  size_t* splitpoints;
+  size_t npoints;
+} ZopfliWarmStart;
+
+/*
+Decodes a zlib stream into LZ77 data.
+zlib: the zlib stream
+zlibsize: size of the zlib stream in bytes
+in: the data the stream decodes to, stays referenced by the LZ77 data
+insize: size of in
+ws: receives the result, clean it with ZopfliCleanWarmStart
+returns 1 on success, 0 when the stream is invalid or does not decode to in.
+ws needs no cleaning then.
+*/
+int ZopfliInitWarmStart(const unsigned char* zlib, size_t zlibsize,
+                        const unsigned char* in, size_t insize,
+                        ZopfliWarmStart* ws);
+
+void ZopfliCleanWarmStart(ZopfliWarmStart* ws);
+
+/*
+Gets the LZ77 data of the bytes from instart to inend (not inclusive). Matches
+that cross one of these borders become literals, distances before instart are
+kept.
+store: initialized store that the LZ77 data is appended to
+*/
+void ZopfliGetWarmStartRange(const ZopfliWarmStart* ws,
+                             size_t instart, size_t inend,
+                             ZopfliLZ77Store* store);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  /* ZOPFLI_WARMSTART_H_ */
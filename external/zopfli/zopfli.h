@@ -27,6 +27,59 @@ Author: jyrki.alakuijala@gmail.com (Jyrki Alakuijala)
 extern "C" {
 #endif
 
+/*
+A job started through ZopfliOptions.runjobs.
+arg: the arg given to the runner, shared by all jobs of a batch
+index: the index of this job in the batch
+*/
+typedef void ZopfliJobFun(void* arg, size_t index);
+
+/*
+Runs job(arg, i) once for each i in [0, numjobs), possibly concurrently, and
+returns once all of them have finished.
+context: the runjobs_context from the options
+*/
+typedef void ZopfliRunJobsFun(void* context, size_t numjobs,
+                              ZopfliJobFun* job, void* arg);
+
+/*
+Asked before every iteration on a block, nonzero stops the iterations of the
+block and keeps its best result so far. Stopping before the first iteration
+keeps the result of the greedy LZ77 pass.
+context: the stop_context from the options
+inend: end of the block in the input, tells how far the whole input is
+*/
+typedef int ZopfliStopFun(void* context, size_t inend);
+
+/*
+Returns the ZopfliContext of the calling thread, see context.h, or NULL.
+context: the getcontext_context from the options
+*/
+typedef struct ZopfliContext* ZopfliGetContextFun(void* context);
+
+/* Parts of a compression that are reported to ZopfliOptions.trace. */
+typedef enum ZopfliPhase {
+  /* The iterations of the optimal LZ77 parse of a block. */
+  ZOPFLI_PHASE_LZ77 = 0,
+  /* Block splitting, before and after the LZ77 optimization. */
+  ZOPFLI_PHASE_SPLIT = 1,
+  /* Choosing the block types and Huffman trees and writing the blocks. */
+  ZOPFLI_PHASE_ENCODE = 2
+} ZopfliPhase;
+
+/*
+Called on the thread that runs a phase when it starts and when it ends. Phases
+of different blocks can run at the same time on other threads, but on one
+thread they do not nest.
+context: the trace_context from the options
+phase: the phase
+end: 0 at the start, 1 at the end
+iterations: at the end of ZOPFLI_PHASE_LZ77 the iterations that ran, summed
+over all seeds, else 0
+*/
+typedef void ZopfliTraceFun(void* context, ZopfliPhase phase, int end,
+                            int iterations);
+
 /*
 Options used throughout the program.
 */
@@ -61,11 +114,138 @@ typedef struct ZopfliOptions {
   extreme results that hurt compression on some files). Default value: 15.
   */
   int blocksplittingmax;
+
+  /*
+  Amount of independently randomized sequences of iterations to run on each
+  block, the smallest result is kept. They run as jobs of runjobs, so with a
+  concurrent runner the extra seeds improve compression at roughly the same
+  wall time. Seed 0 is the regular sequence, so the cost of a block never gets
+  worse with more seeds. Default: 1.
+  */
+  int numseeds;
+
+  /*
+  Stops the iterations on a block once this many iterations in a row did not
+  lower its cost. 0 always runs numiterations iterations. Default: 0.
+  */
+  int numstalliterations;
+
+  /*
+  Lets the caller end the iterations early, for example when a time budget is
+  used up. Default: NULL, which never stops early.
+  */
+  ZopfliStopFun* stop;
+
+  /* Context pointer passed to stop. Default: NULL. */
+  void* stop_context;
+
+  /*
+  Maximum size in bytes of the longest match cache of a block. A large block
+  then caches fewer match lengths per position, or nothing if even that does not
+  fit. This only costs speed, the output stays the same. Without a limit the
+  cache takes 28 bytes per input byte. 0 for no limit. Default: 0.
+  */
+  size_t maxcachesize;
+
+  /*
+  Runs the shortest path search of the iterations with integer costs in units of
+  1/64 bit from tables built once per iteration, instead of double costs from
+  the cost model. This is faster. The rounding can change which of two almost
+  equally good paths is taken, so the output differs slightly: on XYZ images it
+  stayed within 0.5% of the double mode, in either direction. Default: 0.
+  */
+  int fixedpointcosts;
+
+  /*
+  Width in bytes of the rows of a raster image in the input, 0 if there is none.
+  When the search for the longest match stops at maxchainhits, it also tries the
+  same position in the rows above, which the hash chain often did not reach yet.
+  Default: 0.
+  */
+  int rowwidth;
+
+  /*
+  Maximum number of hash chain entries the search for the longest match tries
+  per position. Fewer are faster but can miss matches, rowwidth gets back the
+  ones in the rows above. 0 for the built in limit of ZOPFLI_MAX_CHAIN_HITS.
+  Default: 0.
+  */
+  int maxchainhits;
+
+  /*
+  Measures match lengths with the portable code even where ZOPFLI_SIMD_MATCH
+  would use SSE2 or AVX2, to compare the two or to rule out the SIMD code. The
+  output is the same. Default: 0.
+  */
+  int scalarmatch;
+
+  /*
+  LZ77 data and block boundaries of an earlier compression of the same input,
+  see warmstart.h. The blocks are kept and each one starts its iterations from
+  the earlier LZ77 data instead of a greedy parse. That data also competes with
+  the iterations, so more iterations refine an earlier result instead of
+  starting over. The block splitting after the iterations still applies.
+  Without blocksplitting the earlier blocks are dropped and the single block
+  starts from all of their LZ77 data. Default: NULL, which starts from scratch.
+  */
+  const struct ZopfliWarmStart* warmstart;
+
+  /*
+  Evaluates the best split of both halves of a block together as soon as the
+  block was split, instead of each one when it becomes the largest splittable
+  block. Only has an effect with runjobs. The output stays the same, but when
+  blocksplittingmax ends the splitting some of that work was for nothing.
+  Default: 0.
+  */
+  int speculativesplit;
+
+  /*
+  Runner for work that can be done in parallel: the master blocks of the input,
+  the cost probes of block splitting and the optimization of the blocks found
+  by it. The jobs share no mutable state, the output is identical to running
+  them one after another. It is also used for the seeds of numseeds.
+  Default: NULL, which runs all jobs sequentially on the calling thread.
+  */
+  ZopfliRunJobsFun* runjobs;
+
+  /* Context pointer passed to runjobs. Default: NULL. */
+  void* runjobs_context;
+
+  /*
+  Gives the memory kept between compressions for the calling thread, so that
+  hash tables, LZ77 stores and block sized arrays are reused instead of
+  allocated for every block. The output stays the same.
+  Default: NULL, which allocates everything anew.
+  */
+  ZopfliGetContextFun* getcontext;
+
+  /* Context pointer passed to getcontext. Default: NULL. */
+  void* getcontext_context;
+
+  /*
+  Told when the phases of the compression start and end, to measure where the
+  time goes. Default: NULL.
+  */
+  ZopfliTraceFun* trace;
+
+  /* Context pointer passed to trace. Default: NULL. */
+  void* trace_context;
 } ZopfliOptions;
 
 /* Initializes options with default values. */
 void ZopfliInitOptions(ZopfliOptions* options);
 
+/*
+Runs a batch of jobs with the runner of the options, or sequentially if there
+is none.
+*/
+void ZopfliRunJobs(const ZopfliOptions* options, size_t numjobs,
+                   ZopfliJobFun* job, void* arg);
+
+/* Calls the trace function of the options, if there is one. */
+void ZopfliTrace(const ZopfliOptions* options, ZopfliPhase phase, int end,
+                 int iterations);
+
 #ifdef __cplusplus
 }  // extern "C"
 #endif
@@ -17,14 +17,23 @@
 
 #include <zlib.h>
 #include <png.h>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <fstream>
+#include <mutex>
 #include <sstream>
-#ifdef _WIN32
-# include <algorithm>
-#endif
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <argparse.hpp>
+#include "zlib_container.h"
+#include "atomic_file.h"
+#include "mapped_file.h"
+#include "quantizer.h"
+#include "worker_pool.h"
+#include "zopfli_callbacks.h"
 
 # ifdef __MINGW64_VERSION_MAJOR
 int _dowildcard = -1; /* enable wildcard expansion for mingw-w64 */
@@ -76,190 +85,530 @@ std::string GetPath(const std::string& str) {
 	return s;
 }
 
-int main(int argc, char* argv[]) {
-	if(argc < 2)
-	{
-		std::cout << "Usage: " << argv[0]
-			<< " filename" << std::endl;
-		return 1;
+/** Position of libpng in a PNG file in memory. */
+struct PngSource {
+	const unsigned char* data;
+	size_t size;
+	size_t pos;
+};
+
+/** Hands libpng the next bytes of a PngSource. */
+static void ReadPngData(png_structp png_ptr, png_bytep out, png_size_t length) {
+	PngSource* source = static_cast<PngSource*>(png_get_io_ptr(png_ptr));
+	if(length > source->size - source->pos) {
+		png_error(png_ptr, "Read past the end of the file");
 	}
+	memcpy(out, source->data + source->pos, length);
+	source->pos += length;
+}
 
-	for(int arg = 1; arg < argc; arg++) {
-		FILE *png_file;
-		unsigned char* header;
-		png_structp png_ptr;
-		png_infop info_ptr;
-		unsigned short width;
-		unsigned short height;
-		unsigned int bit_depth;
-		unsigned int color_type;
-		png_colorp palette;
-		int num_palette;
-		png_bytep *row_pointers;
-		Bytef* xyz_data;
-		uLong comp_size;
-		Bytef* comp_data;
-		std::string xyz_filename;
-
-		// Open PNG file
-		png_file = fopen(argv[arg], "rb");
-		if(png_file == NULL) {
-			std::cerr << "Error reading file "
-				<< argv[arg] << "." << std::endl;
-			return 1;
-		}
+/** Size of the buffer that receives the message of a libpng error. */
+static constexpr size_t png_message_size = 256;
+
+/** Keeps the message of a libpng error for the report and jumps back. */
+static void HandlePngError(png_structp png_ptr, png_const_charp message) {
+	char* saved = static_cast<char*>(png_get_error_ptr(png_ptr));
+	snprintf(saved, png_message_size, "%s", message);
+	png_longjmp(png_ptr, 1);
+}
 
-		// Read PNG file header
-		header = new unsigned char[8];
-		if (fread(header, 1, 8, png_file) != 8) {
-			std::cerr << "Error reading PNG header of file "
-				<< argv[arg] << "." << std::endl;
-			delete[] header;
-			return 1;
+/**
+ * Compresses the next bytes of a zlib stream.
+ *
+ * @param stream deflate stream, its total_out bytes of out are used
+ * @param data input bytes
+ * @param size number of input bytes
+ * @param flush Z_NO_FLUSH, or Z_FINISH for the last bytes
+ * @param out receives the compressed data, grows when it is full
+ * @return false on a zlib error
+ */
+static bool DeflateData(z_stream& stream, const Bytef* data, size_t size,
+	int flush, std::vector<Bytef>& out) {
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = static_cast<uInt>(size);
+	for (;;) {
+		if (out.size() == stream.total_out) {
+			out.resize(out.size() * 2 + 1024);
 		}
+		stream.next_out = out.data() + stream.total_out;
+		stream.avail_out = static_cast<uInt>(out.size() - stream.total_out);
 
-		// Check PNG validity
-		if(png_sig_cmp(header, 0, 8) != 0) {
-			std::cerr << "Input file " << argv[arg]
-				<< " is not a PNG file." << std::endl;
-			delete[] header;
-			return 1;
+		int status = deflate(&stream, flush);
+		if (status == Z_STREAM_END) {
+			return true;
 		}
-		delete[] header;
-
-		// Create PNG read structure
-		png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
-			NULL, NULL);
-		if(png_ptr == NULL)
-		{
-			std::cerr << "Error creating PNG read structure for "
-				<< argv[arg] << "." << std::endl;
-			fclose(png_file);
-			return 1;
+		if (status != Z_OK && status != Z_BUF_ERROR) {
+			return false;
 		}
-
-		// Create PNG info structure
-		info_ptr = png_create_info_struct(png_ptr);
-		if(info_ptr == NULL)
-		{
-			std::cerr << "Error creating PNG info structure for "
-				<< argv[arg] << "." << std::endl;
-			png_destroy_read_struct(&png_ptr, NULL, NULL);
-			fclose(png_file);
-			return 1;
+		if (flush != Z_FINISH && stream.avail_in == 0 && stream.avail_out != 0) {
+			return true;
 		}
+	}
+}
 
-		// Init I/O functions
-		if(setjmp(png_jmpbuf(png_ptr)))
-		{
-			std::cerr << "Error initializing PNG I/O for "
-				<< argv[arg] << "." << std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
+/** How the XYZ data gets compressed. */
+struct ConvertSettings {
+	/** Use Zopfli instead of zlib */
+	bool crush = false;
+	ZopfliOptions zopfli;
+	/** Time limit of Zopfli per file, 0 for none */
+	double budget_ms = 0;
+	/** Let Zopfli try the rows above when it stops a match search */
+	bool row_matches = false;
+	/** Dither images that are reduced to 256 colors */
+	bool dither = false;
+};
+
+/**
+ * Buffers of a worker thread. They are reused for every file the thread
+ * converts and keep the size of the largest one.
+ */
+struct Worker {
+	MappedFile png_file;
+	std::vector<Bytef> row_data;
+	std::vector<png_bytep> row_pointers;
+	std::vector<Bytef> comp_data;
+	/** Uncompressed XYZ data, for --crush and for quantized images */
+	std::vector<Bytef> xyz_data;
+	/** Pixels of an image that is not palette based */
+	std::vector<Bytef> rgba_data;
+	/** Content of the XYZ file */
+	std::vector<Bytef> file_data;
+	Quantizer quantizer;
+	/** One stream for all files, deflateReset keeps its memory */
+	z_stream stream = {};
+	bool stream_ready = false;
+
+	~Worker() {
+		if (stream_ready) {
+			deflateEnd(&stream);
 		}
-		png_init_io(png_ptr, png_file);
+	}
+};
 
-		// Already read 8 header bytes, let libpng know about this
-		png_set_sig_bytes(png_ptr, 8);
+/** @return the worker of the calling thread */
+static Worker& GetWorker() {
+	thread_local Worker worker;
+	return worker;
+}
 
-		// Read PNG
-		png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+/**
+ * Compresses the XYZ data of a worker with Zopfli.
+ *
+ * @param settings Zopfli settings
+ * @param width image width
+ * @param worker holds the XYZ data, receives the zlib stream in comp_data
+ * @return size of the zlib stream
+ */
+static size_t Crush(const ConvertSettings& settings, unsigned short width,
+	Worker& worker) {
+	ZopfliOptions options = settings.zopfli;
+	if (settings.row_matches) {
+		options.rowwidth = width;
+	}
+	Budget budget = { std::chrono::steady_clock::now(), settings.budget_ms,
+		worker.xyz_data.size() };
+	if (settings.budget_ms > 0) {
+		options.stop = IsBudgetUsed;
+		options.stop_context = &budget;
+	}
 
-		// Check PNG dimensions
-		width = png_get_image_width(png_ptr, info_ptr);
-		height = png_get_image_height(png_ptr, info_ptr);
+	unsigned char* comp_data = 0;
+	size_t comp_size = 0;
+	ZopfliZlibCompress(&options, worker.xyz_data.data(), worker.xyz_data.size(),
+		&comp_data, &comp_size);
+	worker.comp_data.resize(std::max(worker.comp_data.size(), comp_size));
+	std::copy(comp_data, comp_data + comp_size, worker.comp_data.begin());
+	free(comp_data);
+	return comp_size;
+}
 
-		// Check bit depth validity
-		bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-		if(bit_depth != 8) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " is not using 8 bit depth." << std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
+/**
+ * Converts a PNG file into an XYZ file in the current directory.
+ *
+ * @param filename PNG file
+ * @param settings compression settings
+ * @param worker buffers of the calling thread
+ * @param error receives the error message
+ * @return false on error
+ */
+static bool ConvertFile(const std::string& filename,
+	const ConvertSettings& settings, Worker& worker, std::string& error) {
+	MappedFile& png_file = worker.png_file;
+	std::vector<Bytef>& row_data = worker.row_data;
+	std::vector<png_bytep>& row_pointers = worker.row_pointers;
+	std::vector<Bytef>& comp_data = worker.comp_data;
+	std::vector<Bytef>& xyz_data = worker.xyz_data;
+	std::vector<Bytef>& rgba_data = worker.rgba_data;
+	z_stream& stream = worker.stream;
+	png_structp png_ptr;
+	png_infop info_ptr;
+	unsigned short width;
+	unsigned short height;
+	unsigned int bit_depth;
+	unsigned int color_type;
+	png_colorp palette;
+	int num_palette;
+	Bytef xyz_palette[768];
+	char png_message[png_message_size] = "";
+	bool quantize;
+	bool interlaced;
+	bool compressed;
+	size_t comp_size;
+
+	if (!worker.stream_ready) {
+		if(deflateInit(&stream, Z_BEST_COMPRESSION) != Z_OK) {
+			error = "Error initializing zlib.";
+			return false;
 		}
+		worker.stream_ready = true;
+	}
 
-		// Check color type validity
-		color_type = png_get_color_type(png_ptr, info_ptr);
-		if(color_type != PNG_COLOR_TYPE_PALETTE) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " is not palette based." << std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
-		}
+	// Open PNG file
+	if(!png_file.Open(filename)) {
+		error = "Error reading file " + filename + ".";
+		return false;
+	}
+
+	// Read PNG file header
+	if (png_file.GetSize() < 8) {
+		error = "Error reading PNG header of file " + filename + ".";
+		return false;
+	}
+
+	// Check PNG validity
+	if(png_sig_cmp(png_file.GetData(), 0, 8) != 0) {
+		error = "Input file " + filename + " is not a PNG file.";
+		return false;
+	}
+	PngSource source = { png_file.GetData(), png_file.GetSize(), 8 };
+
+	// Create PNG read structure
+	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, png_message,
+		HandlePngError, NULL);
+	if(png_ptr == NULL)
+	{
+		error = "Error creating PNG read structure for " + filename + ".";
+		return false;
+	}
+
+	// Create PNG info structure
+	info_ptr = png_create_info_struct(png_ptr);
+	if(info_ptr == NULL)
+	{
+		error = "Error creating PNG info structure for " + filename + ".";
+		png_destroy_read_struct(&png_ptr, NULL, NULL);
+		return false;
+	}
+
+	// Init I/O functions. No object that needs destruction may live
+	// across a libpng call below, libpng errors jump back here.
+	if(setjmp(png_jmpbuf(png_ptr)))
+	{
+		error = "Error reading PNG file " + filename + ": " + png_message + ".";
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		return false;
+	}
+	png_set_read_fn(png_ptr, &source, ReadPngData);
+
+	// Already read 8 header bytes, let libpng know about this
+	png_set_sig_bytes(png_ptr, 8);
+
+	// Read PNG header chunks, the rows follow one by one
+	png_read_info(png_ptr, info_ptr);
+
+	// Check PNG dimensions
+	width = png_get_image_width(png_ptr, info_ptr);
+	height = png_get_image_height(png_ptr, info_ptr);
 
+	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	color_type = png_get_color_type(png_ptr, info_ptr);
+
+	// Other images are read as RGBA and reduced to 256 colors afterwards
+	quantize = color_type != PNG_COLOR_TYPE_PALETTE;
+	if (quantize) {
+		png_set_expand(png_ptr);
+		png_set_strip_16(png_ptr);
+		png_set_gray_to_rgb(png_ptr);
+		png_set_add_alpha(png_ptr, 0xff, PNG_FILLER_AFTER);
+	} else {
 		// Check palette chunk validity
 		if(png_get_valid(png_ptr, info_ptr, PNG_INFO_PLTE) == 0) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " has an invalid palette chunk."
-				<< std::endl;
 			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
+			error = "PNG file " + filename + " has an invalid palette chunk.";
+			return false;
 		}
 
 		// Get palette and color count
 		png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette);
 
-		// Check palette color count validity
-		if(num_palette != 256) {
-			std::cerr << "PNG file " << argv[arg]
-				<< " has lesser than 256 colors in palette."
-				<< std::endl;
-			png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-			fclose(png_file);
-			return 1;
+		// A smaller palette is filled up with black, pixels of fewer bits
+		// are unpacked into one byte each
+		memset(xyz_palette, 0, sizeof(xyz_palette));
+		for (int i = 0; i < std::min(num_palette, 256); i++) {
+			xyz_palette[i * 3] = palette[i].red;
+			xyz_palette[i * 3 + 1] = palette[i].green;
+			xyz_palette[i * 3 + 2] = palette[i].blue;
 		}
+		if (bit_depth < 8) {
+			png_set_packing(png_ptr);
+		}
+	}
+	interlaced = png_set_interlace_handling(png_ptr) > 1;
+	png_read_update_info(png_ptr, info_ptr);
+
+	// Collect palette and pixels for Zopfli or the quantizer, the
+	// interlace passes and the rows are read straight into place
+	compressed = true;
+	if (quantize) {
+		rgba_data.resize(std::max(rgba_data.size(),
+			static_cast<size_t>(width) * height * 4));
+		row_pointers.resize(height);
+		for (size_t y = 0; y < height; y++) {
+			row_pointers[y] = &rgba_data[y * width * 4];
+		}
+		png_read_image(png_ptr, row_pointers.data());
+	} else if (settings.crush) {
+		xyz_data.resize(768 + width * height);
+		memcpy(xyz_data.data(), xyz_palette, 768);
+		if (interlaced) {
+			row_pointers.resize(height);
+			for (size_t y = 0; y < height; y++) {
+				row_pointers[y] = &xyz_data[768 + y * width];
+			}
+			png_read_image(png_ptr, row_pointers.data());
+		} else {
+			for (size_t y = 0; y < height; y++) {
+				png_read_row(png_ptr, &xyz_data[768 + y * width], NULL);
+			}
+		}
+	} else {
+		// Usually the whole stream fits, so the buffer never grows
+		deflateReset(&stream);
+		comp_data.resize(std::max<size_t>(comp_data.size(),
+			deflateBound(&stream, 768 + width * height)));
+
+		// Compress XYZ palette
+		compressed = DeflateData(stream, xyz_palette, 768, Z_NO_FLUSH,
+			comp_data);
+
+		// Compress XYZ image. The passes of an interlaced image each fill
+		// in parts of all rows, so it needs the whole image at once
+		row_data.resize(std::max<size_t>(row_data.size(),
+			interlaced ? width * height : width));
+		if (interlaced) {
+			row_pointers.resize(height);
+			for (size_t y = 0; y < height; y++) {
+				row_pointers[y] = &row_data[y * width];
+			}
+			png_read_image(png_ptr, row_pointers.data());
+			compressed = compressed && DeflateData(stream, row_data.data(),
+				width * height, Z_FINISH, comp_data);
+		} else {
+			for (size_t y = 0; y < height; y++) {
+				png_read_row(png_ptr, row_data.data(), NULL);
+				compressed = compressed && DeflateData(stream, row_data.data(),
+					width, Z_NO_FLUSH, comp_data);
+			}
+			compressed = compressed && DeflateData(stream, NULL, 0, Z_FINISH,
+				comp_data);
+		}
+	}
 
-		xyz_data = new unsigned char[768 + width * height];
-
-		// Create XYZ palette
-		for (size_t i = 0; i < 256; i++) {
-			xyz_data[i * 3] = palette[i].red;
-			xyz_data[i * 3 + 1] = palette[i].green;
-			xyz_data[i * 3 + 2] = palette[i].blue;
+	// Close PNG file
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+	png_file.Close();
+
+	if (quantize) {
+		xyz_data.resize(768 + static_cast<size_t>(width) * height);
+		worker.quantizer.Quantize(rgba_data.data(), width, height,
+			settings.dither, xyz_data.data(), xyz_data.data() + 768);
+		if (!settings.crush) {
+			deflateReset(&stream);
+			comp_data.resize(std::max<size_t>(comp_data.size(),
+				deflateBound(&stream, static_cast<uLong>(xyz_data.size()))));
+			compressed = DeflateData(stream, xyz_data.data(), xyz_data.size(),
+				Z_FINISH, comp_data);
 		}
+	}
 
-		// Get image rows
-		row_pointers = png_get_rows(png_ptr, info_ptr);
+	if(!compressed) {
+		error = "Error while compressing XYZ data from " + filename + ".";
+		return false;
+	}
+	comp_size = settings.crush ? Crush(settings, width, worker) :
+		stream.total_out;
+
+	// Through a temporary file, a failure never leaves a cut off XYZ behind
+	std::vector<Bytef>& file_data = worker.file_data;
+	file_data.resize(8);
+	memcpy(&file_data[0], "XYZ1", 4);
+	memcpy(&file_data[4], &width, 2);
+	memcpy(&file_data[6], &height, 2);
+	file_data.insert(file_data.end(), comp_data.begin(), comp_data.begin() + comp_size);
+
+	std::string xyz_filename = GetFilename(filename) + std::string(".xyz");
+	if(!WriteFileAtomic(xyz_filename, file_data)) {
+		error = "Error writing file " + xyz_filename + ".";
+		return false;
+	}
+	return true;
+}
 
-		// Create XYZ image
-		for (size_t y = 0; y < height; y++) {
-			memcpy(&xyz_data[768 + y * width],
-			row_pointers[y], width);
+int main(int argc, char* argv[]) {
+	ConvertSettings settings;
+	ZopfliOptions& zopfli_options = settings.zopfli;
+	ZopfliInitOptions(&zopfli_options);
+	zopfli_options.verbose = 0;
+	zopfli_options.verbose_more = 0;
+	zopfli_options.numiterations = 15;
+	zopfli_options.blocksplitting = 1;
+	zopfli_options.blocksplittinglast = 0;
+	zopfli_options.blocksplittingmax = 15;
+	zopfli_options.getcontext = GetZopfliContext;
+
+	std::vector<std::string> files;
+	int jobs = static_cast<int>(WorkerPool::GetDefaultThreadCount());
+	bool parallel_blocks = false;
+	int seeds = 1;
+	int match_cache_mb = 0;
+	int row_matches = 0;
+	bool fixed_point = false;
+
+	argparse::ArgumentParser cli("png2xyz", PACKAGE_VERSION);
+	cli.set_usage_max_line_width(100);
+	cli.add_description("Converts PNG images into RPG Maker XYZ images. Images without\n"
+		"a palette are reduced to 256 colors, transparent pixels get\n"
+		"the transparent color 0.\n"
+		"The results are written into the current directory.");
+	cli.add_epilog("Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
+
+	cli.add_argument("FILE").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(files).help("PNG files to convert");
+	cli.add_argument("-j", "--jobs").store_into(jobs)
+		.help("Number of files converted in parallel\n"
+			"(default: number of hardware threads)").metavar("N");
+	cli.add_argument("-d", "--dither").store_into(settings.dither)
+		.help("Dither images that are reduced to 256 colors, smoother\n"
+			"gradients but a larger file");
+	cli.add_argument("-c", "--crush").store_into(settings.crush)
+		.help("Compress with Zopfli like xyzcrush does, much slower but\n"
+			"smaller. The following options tune it");
+	cli.add_argument("-p", "--parallel-blocks").store_into(parallel_blocks)
+		.help("Also compress the deflate blocks of a single file and\n"
+			"search their split points in parallel, helps when there\n"
+			"are fewer files than threads");
+	cli.add_argument("-s", "--seeds").store_into(seeds)
+		.help("Number of differently randomized optimizations per block,\n"
+			"run on the worker threads, the smallest wins (default: 1)")
+		.metavar("K");
+	cli.add_argument("-b", "--budget-ms").store_into(settings.budget_ms)
+		.help("Time limit for the optimization of a file in milliseconds.\n"
+			"The iterations then also stop once they no longer shrink\n"
+			"the file, small files may get more of them").metavar("MS");
+	cli.add_argument("-m", "--match-cache-mb").store_into(match_cache_mb)
+		.help("Memory limit of the match cache of one block in MB. Less\n"
+			"memory is slower, the output stays the same\n"
+			"(default: 0, about 28 bytes per image byte)").metavar("MB");
+	cli.add_argument("-f", "--fixed-point").store_into(fixed_point)
+		.help("Use faster integer costs in the optimization, the result\n"
+			"can be slightly larger or smaller");
+	cli.add_argument("-w", "--row-matches").store_into(row_matches)
+		.help("Walk at most HITS hash chain entries per position when\n"
+			"searching matches and try the rows above instead. Faster,\n"
+			"a little larger; 32 is a good start (default: 0, full search)")
+		.metavar("HITS");
+
+	try {
+		cli.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << std::endl;
+		std::cerr << cli.usage() << std::endl;
+		return 1;
+	}
+
+	if (jobs < 1) {
+		std::cerr << "--jobs must be at least 1." << std::endl;
+		return 1;
+	}
+	if (seeds < 1) {
+		std::cerr << "--seeds must be at least 1." << std::endl;
+		return 1;
+	}
+	zopfli_options.numseeds = seeds;
+	if (settings.budget_ms < 0) {
+		std::cerr << "--budget-ms must not be negative." << std::endl;
+		return 1;
+	}
+	if (match_cache_mb < 0) {
+		std::cerr << "--match-cache-mb must not be negative." << std::endl;
+		return 1;
+	}
+	zopfli_options.maxcachesize = static_cast<size_t>(match_cache_mb) * 1024 * 1024;
+	zopfli_options.fixedpointcosts = fixed_point;
+	if (row_matches < 0) {
+		std::cerr << "--row-matches must not be negative." << std::endl;
+		return 1;
+	}
+	zopfli_options.maxchainhits = row_matches;
+	settings.row_matches = row_matches > 0;
+	if (settings.budget_ms > 0) {
+		// The time and the stall limit end the iterations, the count is only
+		// a cap, so small images can go further than the usual 15
+		zopfli_options.numiterations = 60;
+		zopfli_options.numstalliterations = 5;
+	}
+
+	// Files with the same output name are converted one after another in
+	// command line order, so that the last one wins like in a serial run
+	std::vector<std::vector<size_t>> groups;
+	std::unordered_map<std::string, size_t> group_of;
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto it = group_of.emplace(GetFilename(files[i]), groups.size()).first;
+		if (it->second == groups.size()) {
+			groups.emplace_back();
 		}
+		groups[it->second].push_back(i);
+	}
 
-		// Close PNG file
-		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-		fclose(png_file);
-
-		// Compress XYZ data
-		comp_size = compressBound(768 + width * height);
-		comp_data = new Bytef[comp_size];
-
-		int errorcode = compress2(comp_data, &comp_size, xyz_data,
-			768 + width * height, Z_BEST_COMPRESSION);
-		delete[] xyz_data;
-		if(errorcode != Z_OK) {
-			std::cerr << "Error while compressing XYZ data from "
-				<< argv[arg] << "." << std::endl;
-			delete[] comp_data;
-			return 1;
+	std::vector<std::string> errors(files.size());
+	std::vector<char> done(files.size());
+	std::mutex report_mutex;
+	size_t next_report = 0;
+	size_t failed = 0;
+
+	WorkerPool pool(static_cast<unsigned>(jobs));
+	if (parallel_blocks || seeds > 1) {
+		zopfli_options.runjobs = RunZopfliJobs;
+		zopfli_options.runjobs_context = &pool;
+		zopfli_options.speculativesplit = parallel_blocks;
+	}
+	pool.ParallelFor(groups.size(), [&](size_t group) {
+		for (size_t i : groups[group]) {
+			std::string error;
+			ConvertFile(files[i], settings, GetWorker(), error);
+
+			// Report in command line order, independent of completion order
+			std::lock_guard<std::mutex> lock(report_mutex);
+			errors[i] = std::move(error);
+			done[i] = true;
+			for (; next_report < files.size() && done[next_report]; ++next_report) {
+				if (!errors[next_report].empty()) {
+					std::cerr << errors[next_report] << std::endl;
+					failed++;
+				}
+			}
 		}
+	});
 
-		std::stringstream ss;
-		ss << GetFilename(argv[arg]) + std::string(".xyz");
-		xyz_filename = ss.str();
-		std::ofstream xyz_file(xyz_filename.c_str(), std::ofstream::binary);
-		xyz_file.write("XYZ1", 4);
-		xyz_file.write(reinterpret_cast<char*>(&width), 2);
-		xyz_file.write(reinterpret_cast<char*>(&height), 2);
-		xyz_file.write(reinterpret_cast<char*>(comp_data), comp_size);
-		xyz_file.close();
-		delete[] comp_data;
+	if (files.size() > 1) {
+		std::cout << "Converted " << files.size() - failed << " of "
+			<< files.size() << " files";
+		if (failed > 0) {
+			std::cout << ", " << failed << " failed";
+		}
+		std::cout << "." << std::endl;
 	}
 
-	return 0;
+	return failed > 0 ? 1 : 0;
 }
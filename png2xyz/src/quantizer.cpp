@@ -0,0 +1,424 @@
+/*
+ * This file is part of png2xyz. Copyright (c) 2026 png2xyz authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "quantizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define PNG2XYZ_SSE2
+#endif
+
+namespace {
+	/** Palette entries searched by FindNearest, indices 1 to 255 plus padding */
+	constexpr size_t search_size = 256;
+
+	/** Distance of unused palette entries, never the nearest */
+	constexpr float unused_color = 1e9f;
+
+	/** Low 24 bits of a color_set slot */
+	constexpr uint32_t color_mask = 0xffffff;
+
+	uint32_t GetColor(const uint8_t* pixel) {
+		return pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+	}
+
+	/** @return slot of the color in the open addressing color set */
+	size_t FindSlot(const std::vector<uint32_t>& color_set, uint32_t color) {
+		size_t slot = (color * 2654435761u) >> 23;
+		while (color_set[slot] != 0 && (color_set[slot] & color_mask) != color) {
+			slot = (slot + 1) & 511;
+		}
+		return slot;
+	}
+
+	int GetCell(int r, int g, int b) {
+		return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+	}
+
+	int Clamp(int value) {
+		return std::min(std::max(value, 0), 255);
+	}
+}
+
+void Quantizer::Quantize(const uint8_t* rgba, size_t width, size_t height,
+		bool dither, uint8_t* palette, uint8_t* pixels) {
+	size_t size = width * height;
+	memset(palette, 0, 768);
+
+	// Keep the color of transparent pixels as transparent color
+	for (size_t i = 0; i < size; ++i) {
+		if (rgba[i * 4 + 3] == 0) {
+			memcpy(palette, rgba + i * 4, 3);
+			break;
+		}
+	}
+
+	size_t colors;
+	if (FindExactColors(rgba, size, palette, colors)) {
+		// Nothing is lost, so there is no error to spread
+		MapExact(rgba, size, pixels);
+		return;
+	}
+	BuildHistogram(rgba, size);
+	colors = MedianCut(palette);
+	Map(rgba, width, height, dither, palette, colors, pixels);
+}
+
+bool Quantizer::FindExactColors(const uint8_t* rgba, size_t size,
+		uint8_t* palette, size_t& colors) {
+	// Open addressing at half load. A slot holds the color and its index
+	// in the top byte, 0 marks a free slot.
+	color_set.assign(512, 0);
+	colors = 0;
+
+	uint32_t last = 0xffffffff;
+	for (size_t i = 0; i < size; ++i) {
+		const uint8_t* pixel = rgba + i * 4;
+		if (pixel[3] == 0) {
+			continue;
+		}
+		uint32_t color = GetColor(pixel);
+		if (color == last) {
+			continue;
+		}
+		last = color;
+
+		size_t slot = FindSlot(color_set, color);
+		if (color_set[slot] != 0) {
+			continue;
+		}
+		if (colors == 255) {
+			return false;
+		}
+		colors++;
+		color_set[slot] = color | static_cast<uint32_t>(colors << 24);
+		memcpy(palette + colors * 3, pixel, 3);
+	}
+	return true;
+}
+
+void Quantizer::MapExact(const uint8_t* rgba, size_t size, uint8_t* pixels) const {
+	uint32_t last = 0xffffffff;
+	uint8_t last_index = 0;
+	for (size_t i = 0; i < size; ++i) {
+		const uint8_t* pixel = rgba + i * 4;
+		if (pixel[3] == 0) {
+			pixels[i] = 0;
+			continue;
+		}
+		uint32_t color = GetColor(pixel);
+		if (color != last) {
+			last = color;
+			last_index = static_cast<uint8_t>(color_set[FindSlot(color_set, color)] >> 24);
+		}
+		pixels[i] = last_index;
+	}
+}
+
+void Quantizer::BuildHistogram(const uint8_t* rgba, size_t size) {
+	cell_of.assign(1 << 15, -1);
+	cells.clear();
+
+	for (size_t i = 0; i < size; ++i) {
+		const uint8_t* pixel = rgba + i * 4;
+		if (pixel[3] == 0) {
+			continue;
+		}
+		int key = GetCell(pixel[0], pixel[1], pixel[2]);
+		if (cell_of[key] < 0) {
+			cell_of[key] = static_cast<int32_t>(cells.size());
+			cells.push_back(Cell());
+		}
+		Cell& cell = cells[cell_of[key]];
+		cell.count++;
+		for (int c = 0; c < 3; ++c) {
+			cell.sum[c] += pixel[c];
+		}
+	}
+
+	for (Cell& cell : cells) {
+		for (int c = 0; c < 3; ++c) {
+			cell.color[c] = static_cast<uint8_t>(cell.sum[c] / cell.count);
+		}
+	}
+}
+
+void Quantizer::MeasureBox(Box& box) const {
+	int low[3] = { 255, 255, 255 };
+	int high[3] = { 0, 0, 0 };
+	box.count = 0;
+	for (size_t i = box.begin; i < box.end; ++i) {
+		const Cell& cell = cells[i];
+		box.count += cell.count;
+		for (int c = 0; c < 3; ++c) {
+			low[c] = std::min<int>(low[c], cell.color[c]);
+			high[c] = std::max<int>(high[c], cell.color[c]);
+		}
+	}
+	box.channel = 0;
+	box.range = -1;
+	for (int c = 0; c < 3; ++c) {
+		if (high[c] - low[c] > box.range) {
+			box.channel = c;
+			box.range = high[c] - low[c];
+		}
+	}
+}
+
+size_t Quantizer::MedianCut(uint8_t* palette) {
+	boxes.clear();
+	Box all = { 0, cells.size(), 0, 0, 0 };
+	MeasureBox(all);
+	boxes.push_back(all);
+
+	while (boxes.size() < 255) {
+		// Split the box with the most pixels times color range
+		Box* box = nullptr;
+		for (Box& candidate : boxes) {
+			if (candidate.range > 0 && (!box ||
+					candidate.count * candidate.range > box->count * box->range)) {
+				box = &candidate;
+			}
+		}
+		if (!box) {
+			break;
+		}
+
+		// Weighted median of the channel, both halves keep at least one
+		// value. Counting by value is faster than sorting the cells.
+		int channel = box->channel;
+		uint64_t weight[256] = {};
+		int low = 255;
+		int high = 0;
+		for (size_t i = box->begin; i < box->end; ++i) {
+			int value = cells[i].color[channel];
+			weight[value] += cells[i].count;
+			low = std::min(low, value);
+			high = std::max(high, value);
+		}
+		int median = low;
+		uint64_t below = weight[low];
+		while (median < high - 1 && below * 2 < box->count) {
+			below += weight[++median];
+		}
+		size_t split = std::partition(cells.begin() + box->begin,
+			cells.begin() + box->end, [channel, median](const Cell& cell) {
+				return cell.color[channel] <= median;
+			}) - cells.begin();
+
+		Box upper = { split, box->end, 0, 0, 0 };
+		box->end = split;
+		MeasureBox(*box);
+		MeasureBox(upper);
+		boxes.push_back(upper);
+	}
+
+	memset(palette + 3, 0, 765);
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		uint64_t sum[3] = {};
+		for (size_t cell = boxes[i].begin; cell < boxes[i].end; ++cell) {
+			for (int c = 0; c < 3; ++c) {
+				sum[c] += cells[cell].sum[c];
+			}
+		}
+		uint64_t count = boxes[i].count;
+		for (int c = 0; c < 3; ++c) {
+			palette[(i + 1) * 3 + c] = static_cast<uint8_t>((sum[c] * 2 + count) / (count * 2));
+		}
+	}
+	return cells.empty() ? 0 : boxes.size();
+}
+
+int Quantizer::FindNearest(int r, int g, int b) const {
+	// Ties go to the lowest index in both versions
+#ifdef PNG2XYZ_SSE2
+	const __m128 target[3] = { _mm_set1_ps(static_cast<float>(r)),
+		_mm_set1_ps(static_cast<float>(g)), _mm_set1_ps(static_cast<float>(b)) };
+	__m128 best = _mm_set1_ps(FLT_MAX);
+	__m128i best_index = _mm_setzero_si128();
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i step = _mm_set1_epi32(4);
+
+	for (size_t i = 0; i < search_size; i += 4) {
+		__m128 dr = _mm_sub_ps(_mm_loadu_ps(&channels[0][i]), target[0]);
+		__m128 dg = _mm_sub_ps(_mm_loadu_ps(&channels[1][i]), target[1]);
+		__m128 db = _mm_sub_ps(_mm_loadu_ps(&channels[2][i]), target[2]);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr),
+			_mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+
+		__m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+		best = _mm_min_ps(best, distance);
+		best_index = _mm_or_si128(_mm_and_si128(closer, index),
+			_mm_andnot_si128(closer, best_index));
+		index = _mm_add_epi32(index, step);
+	}
+
+	alignas(16) float lane_distance[4];
+	alignas(16) int32_t lane_index[4];
+	_mm_store_ps(lane_distance, best);
+	_mm_store_si128(reinterpret_cast<__m128i*>(lane_index), best_index);
+	int nearest = lane_index[0];
+	float nearest_distance = lane_distance[0];
+	for (int lane = 1; lane < 4; ++lane) {
+		if (lane_distance[lane] < nearest_distance ||
+				(lane_distance[lane] == nearest_distance && lane_index[lane] < nearest)) {
+			nearest = lane_index[lane];
+			nearest_distance = lane_distance[lane];
+		}
+	}
+	return nearest + 1;
+#else
+	int nearest = 0;
+	float nearest_distance = FLT_MAX;
+	for (size_t i = 0; i < search_size; ++i) {
+		float dr = channels[0][i] - r;
+		float dg = channels[1][i] - g;
+		float db = channels[2][i] - b;
+		float distance = dr * dr + dg * dg + db * db;
+		if (distance < nearest_distance) {
+			nearest = static_cast<int>(i);
+			nearest_distance = distance;
+		}
+	}
+	return nearest + 1;
+#endif
+}
+
+int32_t Quantizer::FindCandidates(int r, int g, int b) {
+	// A palette color can only be the nearest for some color of the cell
+	// when its distance to the cell box is at most the largest distance of
+	// the color that is closest in the worst case
+	int near_distance[search_size];
+	int bound = INT_MAX;
+	for (size_t i = 0; i < palette_colors; ++i) {
+		const int low[3] = { r, g, b };
+		int near = 0;
+		int far = 0;
+		for (int c = 0; c < 3; ++c) {
+			int value = static_cast<int>(channels[c][i]);
+			int below = low[c] - value;
+			int above = value - (low[c] + 7);
+			int outside = std::max(std::max(below, above), 0);
+			int inside = std::max(value - low[c], low[c] + 7 - value);
+			near += outside * outside;
+			far += inside * inside;
+		}
+		near_distance[i] = near;
+		bound = std::min(bound, far);
+	}
+
+	int32_t offset = static_cast<int32_t>(candidates.size());
+	candidates.push_back(0);
+	for (size_t i = 0; i < palette_colors; ++i) {
+		if (near_distance[i] <= bound) {
+			candidates.push_back(static_cast<uint8_t>(i));
+			candidates[offset]++;
+		}
+	}
+	return offset;
+}
+
+uint8_t Quantizer::FindNearestCached(int r, int g, int b) {
+	int32_t& offset = cell_candidates[GetCell(r, g, b)];
+	if (offset < 0) {
+		offset = FindCandidates(r & ~7, g & ~7, b & ~7);
+	}
+
+	// The vector search is faster than a long list. Candidates are in
+	// palette order, ties go to the lowest index like in FindNearest.
+	const uint8_t* list = candidates.data() + offset;
+	if (list[0] > 32) {
+		return static_cast<uint8_t>(FindNearest(r, g, b));
+	}
+	int nearest = list[1];
+	float nearest_distance = FLT_MAX;
+	for (int k = 1; k <= list[0]; ++k) {
+		int i = list[k];
+		float dr = channels[0][i] - r;
+		float dg = channels[1][i] - g;
+		float db = channels[2][i] - b;
+		float distance = dr * dr + dg * dg + db * db;
+		if (distance < nearest_distance) {
+			nearest = i;
+			nearest_distance = distance;
+		}
+	}
+	return static_cast<uint8_t>(nearest + 1);
+}
+
+void Quantizer::Map(const uint8_t* rgba, size_t width, size_t height,
+		bool dither, const uint8_t* palette, size_t colors, uint8_t* pixels) {
+	for (int c = 0; c < 3; ++c) {
+		channels[c].assign(search_size, unused_color);
+		for (size_t i = 0; i < colors; ++i) {
+			channels[c][i] = palette[(i + 1) * 3 + c];
+		}
+	}
+
+	palette_colors = colors;
+	cell_candidates.assign(1 << 15, -1);
+	candidates.clear();
+
+	if (!dither) {
+		for (size_t i = 0; i < width * height; ++i) {
+			const uint8_t* pixel = rgba + i * 4;
+			pixels[i] = pixel[3] == 0 ? 0 : FindNearestCached(pixel[0], pixel[1], pixel[2]);
+		}
+		return;
+	}
+
+	// Errors in 1/16 steps, one pixel of padding on both sides of a row
+	size_t stride = (width + 2) * 3;
+	errors.assign(stride * 2, 0);
+	int* current = errors.data();
+	int* next = errors.data() + stride;
+
+	for (size_t y = 0; y < height; ++y) {
+		for (size_t x = 0; x < width; ++x) {
+			size_t i = y * width + x;
+			const uint8_t* pixel = rgba + i * 4;
+			if (pixel[3] == 0) {
+				pixels[i] = 0;
+				continue;
+			}
+
+			int* error = current + (x + 1) * 3;
+			int color[3];
+			for (int c = 0; c < 3; ++c) {
+				color[c] = Clamp(pixel[c] + error[c] / 16);
+			}
+			int index = FindNearestCached(color[0], color[1], color[2]);
+			pixels[i] = static_cast<uint8_t>(index);
+
+			int* below = next + (x + 1) * 3;
+			for (int c = 0; c < 3; ++c) {
+				int diff = color[c] - palette[index * 3 + c];
+				error[3 + c] += diff * 7;
+				below[c - 3] += diff * 3;
+				below[c] += diff * 5;
+				below[c + 3] += diff;
+			}
+		}
+		std::swap(current, next);
+		std::fill(next, next + stride, 0);
+	}
+}
@@ -0,0 +1,118 @@
+/*
+ * This file is part of png2xyz. Copyright (c) 2026 png2xyz authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PNG2XYZ_QUANTIZER
+#define PNG2XYZ_QUANTIZER
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Reduces RGBA images to the 256 color palette of an XYZ image.
+ *
+ * Index 0 is the transparent color of RPG Maker: fully transparent pixels
+ * get index 0 and all other pixels one of the indices 1 to 255, any other
+ * alpha counts as opaque. Images with at most 255 opaque colors keep them
+ * exactly, larger ones get a median cut palette.
+ *
+ * The buffers are kept between images, one instance per thread converts
+ * many small images without allocating.
+ */
+class Quantizer {
+public:
+	/**
+	 * @param rgba pixels, 4 bytes each
+	 * @param width image width
+	 * @param height image height
+	 * @param dither spread the color error of each pixel to its neighbours
+	 *        (Floyd-Steinberg), only used when colors are lost
+	 * @param palette receives 256 RGB colors
+	 * @param pixels receives width * height palette indices
+	 */
+	void Quantize(const uint8_t* rgba, size_t width, size_t height,
+		bool dither, uint8_t* palette, uint8_t* pixels);
+
+private:
+	/** Opaque colors that fall into one 15 bit histogram cell */
+	struct Cell {
+		uint32_t count;
+		uint64_t sum[3];
+		/** Mean color, the coordinates of the cell for the median cut */
+		uint8_t color[3];
+	};
+
+	/** Range of cells that becomes one palette color */
+	struct Box {
+		size_t begin;
+		size_t end;
+		uint64_t count;
+		/** Channel with the largest range and that range */
+		int channel;
+		int range;
+	};
+
+	/**
+	 * Puts the opaque colors in order of appearance into the palette,
+	 * starting at index 1.
+	 *
+	 * @return false when there are more than 255 of them
+	 */
+	bool FindExactColors(const uint8_t* rgba, size_t size, uint8_t* palette,
+		size_t& colors);
+	/** Maps the pixels to the colors found by FindExactColors */
+	void MapExact(const uint8_t* rgba, size_t size, uint8_t* pixels) const;
+	void BuildHistogram(const uint8_t* rgba, size_t size);
+	/** @return number of palette colors, starting at index 1 */
+	size_t MedianCut(uint8_t* palette);
+	void MeasureBox(Box& box) const;
+	void Map(const uint8_t* rgba, size_t width, size_t height, bool dither,
+		const uint8_t* palette, size_t colors, uint8_t* pixels);
+	/** @return index 1 to 255 of the nearest palette color */
+	int FindNearest(int r, int g, int b) const;
+	/**
+	 * Collects the palette colors that are the nearest one for at least
+	 * one color of a 15 bit cell.
+	 *
+	 * @return offset of the list in candidates
+	 */
+	int32_t FindCandidates(int r, int g, int b);
+	/**
+	 * FindNearest that only searches the candidates of the 15 bit cell of
+	 * the color, the result is the same.
+	 */
+	uint8_t FindNearestCached(int r, int g, int b);
+
+	/** Exact colors with their palette index */
+	std::vector<uint32_t> color_set;
+	/** Cell of each 15 bit color, or -1 */
+	std::vector<int32_t> cell_of;
+	std::vector<Cell> cells;
+	std::vector<Box> boxes;
+	/** Number of palette colors Map searches */
+	size_t palette_colors = 0;
+	/** Offset in candidates of each 15 bit color, -1 when not collected yet */
+	std::vector<int32_t> cell_candidates;
+	/** Per cell the number of candidates and their index minus 1 */
+	std::vector<uint8_t> candidates;
+	/** Palette colors 1 to 255 per channel, padded for SIMD */
+	std::vector<float> channels[3];
+	/** Color error of the current and the next row while dithering */
+	std::vector<int> errors;
+};
+
+#endif
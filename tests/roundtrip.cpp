@@ -0,0 +1,695 @@
+/*
+ * This file is part of EasyRPG Tools. Copyright (c) 2026 EasyRPG Tools authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Round trip tests of xyzcrush and png2xyz.
+ *
+ * Usage: roundtrip CASE TOOL
+ *
+ * Every case generates its images into a fresh directory named after the
+ * case, runs TOOL on them and decodes the written XYZ files. The images
+ * are computed with integer math only, so all platforms test the same
+ * bytes.
+ */
+
+#include <zlib.h>
+#include <png.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+	/** Decoded content of an XYZ file. */
+	struct Image {
+		unsigned short width = 0;
+		unsigned short height = 0;
+		/** 256 RGB colors */
+		std::vector<unsigned char> palette;
+		/** One palette index per pixel */
+		std::vector<unsigned char> pixels;
+	};
+
+	/** Pixels of a PNG file before it is written. */
+	struct PngImage {
+		int width = 0;
+		int height = 0;
+		int color_type = PNG_COLOR_TYPE_PALETTE;
+		int bit_depth = 8;
+		bool interlaced = false;
+		std::vector<png_color> palette;
+		/** Unpacked rows, one byte per channel */
+		std::vector<unsigned char> data;
+	};
+
+	int failures = 0;
+
+	/** Reports a failed check, the test fails at the end. */
+	void Expect(bool ok, const std::string& what) {
+		if (!ok) {
+			std::cerr << "FAILED: " << what << std::endl;
+			failures++;
+		}
+	}
+
+	/** @return the same pseudo random numbers on every platform */
+	unsigned int Random(unsigned int& state) {
+		state = state * 1103515245u + 12345u;
+		return (state >> 16) & 0x7fff;
+	}
+
+	/** Palette of the generated XYZ images, index 0 is transparent. */
+	std::vector<unsigned char> MakePalette() {
+		std::vector<unsigned char> palette(768);
+		for (int i = 0; i < 256; ++i) {
+			palette[i * 3] = static_cast<unsigned char>(i * 37);
+			palette[i * 3 + 1] = static_cast<unsigned char>(255 - i * 3);
+			palette[i * 3 + 2] = static_cast<unsigned char>(i * 91 + 7);
+		}
+		return palette;
+	}
+
+	/** Tiles of 16 colors with a transparent corner, compresses well. */
+	Image MakeTiles() {
+		Image image;
+		image.width = 48;
+		image.height = 32;
+		image.palette = MakePalette();
+		for (int y = 0; y < image.height; ++y) {
+			for (int x = 0; x < image.width; ++x) {
+				int index = ((x / 8 + y / 8) % 2) ? 1 + x % 4 : 5 + (x + y) % 11;
+				image.pixels.push_back(static_cast<unsigned char>(
+					x + y < 10 ? 0 : index));
+			}
+		}
+		return image;
+	}
+
+	/** 200 colors in diagonal bands. */
+	Image MakeGradient() {
+		Image image;
+		image.width = 40;
+		image.height = 24;
+		image.palette = MakePalette();
+		for (int y = 0; y < image.height; ++y) {
+			for (int x = 0; x < image.width; ++x) {
+				image.pixels.push_back(static_cast<unsigned char>(
+					1 + (x * 3 + y * 5) % 200));
+			}
+		}
+		return image;
+	}
+
+	/** Random indices, hardly compressible. */
+	Image MakeNoise() {
+		Image image;
+		image.width = 24;
+		image.height = 16;
+		image.palette = MakePalette();
+		unsigned int state = 1;
+		for (int i = 0; i < image.width * image.height; ++i) {
+			image.pixels.push_back(static_cast<unsigned char>(Random(state)));
+		}
+		return image;
+	}
+
+	std::vector<unsigned char> ReadFile(const fs::path& filename) {
+		std::ifstream file(filename, std::ios::binary);
+		return std::vector<unsigned char>(std::istreambuf_iterator<char>(file),
+			std::istreambuf_iterator<char>());
+	}
+
+	bool WriteFile(const fs::path& filename, const std::vector<unsigned char>& data) {
+		std::ofstream file(filename, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return static_cast<bool>(file);
+	}
+
+	/** Writes an XYZ file compressed with zlib level 6, so it can shrink. */
+	bool WriteXyz(const fs::path& filename, const Image& image) {
+		std::vector<unsigned char> payload(image.palette);
+		payload.insert(payload.end(), image.pixels.begin(), image.pixels.end());
+		uLongf comp_size = compressBound(static_cast<uLong>(payload.size()));
+		std::vector<unsigned char> data(8 + comp_size);
+		memcpy(&data[0], "XYZ1", 4);
+		data[4] = image.width & 0xff;
+		data[5] = image.width >> 8;
+		data[6] = image.height & 0xff;
+		data[7] = image.height >> 8;
+		if (compress2(&data[8], &comp_size, payload.data(),
+				static_cast<uLong>(payload.size()), 6) != Z_OK) {
+			return false;
+		}
+		data.resize(8 + comp_size);
+		return WriteFile(filename, data);
+	}
+
+	/**
+	 * Decodes an XYZ file. The zlib stream must hold exactly the palette
+	 * and the pixels.
+	 */
+	bool ReadXyz(const fs::path& filename, Image& image) {
+		std::vector<unsigned char> data = ReadFile(filename);
+		if (data.size() < 8 || memcmp(data.data(), "XYZ1", 4) != 0) {
+			return false;
+		}
+		image.width = static_cast<unsigned short>(data[4] | (data[5] << 8));
+		image.height = static_cast<unsigned short>(data[6] | (data[7] << 8));
+		std::vector<unsigned char> payload(768 + image.width * image.height);
+		uLongf size = static_cast<uLongf>(payload.size());
+		if (uncompress(payload.data(), &size, &data[8],
+				static_cast<uLong>(data.size() - 8)) != Z_OK || size != payload.size()) {
+			return false;
+		}
+		image.palette.assign(payload.begin(), payload.begin() + 768);
+		image.pixels.assign(payload.begin() + 768, payload.end());
+		return true;
+	}
+
+	bool SamePayload(const Image& a, const Image& b) {
+		return a.width == b.width && a.height == b.height &&
+			a.palette == b.palette && a.pixels == b.pixels;
+	}
+
+	/**
+	 * Compares what the images show: the color of every pixel and which
+	 * pixels are transparent. The palette order may differ.
+	 */
+	bool SameShownPixels(const Image& a, const Image& b) {
+		if (a.width != b.width || a.height != b.height) {
+			return false;
+		}
+		for (size_t i = 0; i < a.pixels.size(); ++i) {
+			int ia = a.pixels[i];
+			int ib = b.pixels[i];
+			if ((ia == 0) != (ib == 0) ||
+					memcmp(&a.palette[ia * 3], &b.palette[ib * 3], 3) != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool WritePng(const fs::path& filename, const PngImage& image) {
+		// Nothing that needs destruction may live across the libpng calls
+		size_t stride = image.data.size() / image.height;
+		std::vector<png_bytep> rows;
+		for (int y = 0; y < image.height; ++y) {
+			rows.push_back(const_cast<png_bytep>(&image.data[y * stride]));
+		}
+
+		FILE* file = fopen(filename.string().c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+			NULL, NULL, NULL);
+		png_infop info_ptr = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+		if (!info_ptr || setjmp(png_jmpbuf(png_ptr))) {
+			png_destroy_write_struct(&png_ptr, &info_ptr);
+			fclose(file);
+			return false;
+		}
+
+		png_init_io(png_ptr, file);
+		png_set_IHDR(png_ptr, info_ptr, image.width, image.height,
+			image.bit_depth, image.color_type,
+			image.interlaced ? PNG_INTERLACE_ADAM7 : PNG_INTERLACE_NONE,
+			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+		if (!image.palette.empty()) {
+			png_set_PLTE(png_ptr, info_ptr, image.palette.data(),
+				static_cast<int>(image.palette.size()));
+		}
+		png_write_info(png_ptr, info_ptr);
+		if (image.bit_depth < 8) {
+			png_set_packing(png_ptr);
+		}
+		png_set_interlace_handling(png_ptr);
+
+		png_write_image(png_ptr, rows.data());
+		png_write_end(png_ptr, NULL);
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return fclose(file) == 0;
+	}
+
+	/** Paletted PNG of an XYZ image with the first colors of its palette. */
+	PngImage MakePalettePng(const Image& image, int colors, int bit_depth,
+			bool interlaced) {
+		PngImage png;
+		png.width = image.width;
+		png.height = image.height;
+		png.bit_depth = bit_depth;
+		png.interlaced = interlaced;
+		for (int i = 0; i < colors; ++i) {
+			png.palette.push_back({ image.palette[i * 3],
+				image.palette[i * 3 + 1], image.palette[i * 3 + 2] });
+		}
+		png.data = image.pixels;
+		return png;
+	}
+
+	/** RGBA PNG showing an XYZ image, index 0 is fully transparent. */
+	PngImage MakeRgbaPng(const Image& image) {
+		PngImage png;
+		png.width = image.width;
+		png.height = image.height;
+		png.color_type = PNG_COLOR_TYPE_RGBA;
+		for (unsigned char index : image.pixels) {
+			png.data.insert(png.data.end(), &image.palette[index * 3],
+				&image.palette[index * 3 + 3]);
+			// Partial alpha counts as opaque
+			png.data.push_back(index == 0 ? 0 : 128 + index % 128);
+		}
+		return png;
+	}
+
+	/** RGB PNG with more than 255 colors, which png2xyz has to reduce. */
+	PngImage MakeTruecolorPng() {
+		PngImage png;
+		png.width = 64;
+		png.height = 48;
+		png.color_type = PNG_COLOR_TYPE_RGB;
+		for (int y = 0; y < png.height; ++y) {
+			for (int x = 0; x < png.width; ++x) {
+				png.data.push_back(static_cast<unsigned char>(x * 4));
+				png.data.push_back(static_cast<unsigned char>(y * 5));
+				png.data.push_back(static_cast<unsigned char>((x * y) & 0xff));
+			}
+		}
+		return png;
+	}
+
+	/** Gray PNG with 250 shades, which fit into the palette. */
+	PngImage MakeGrayPng() {
+		PngImage png;
+		png.width = 40;
+		png.height = 24;
+		png.color_type = PNG_COLOR_TYPE_GRAY;
+		png.interlaced = true;
+		for (int y = 0; y < png.height; ++y) {
+			for (int x = 0; x < png.width; ++x) {
+				png.data.push_back(static_cast<unsigned char>((x * 5 + y * 3) % 250));
+			}
+		}
+		return png;
+	}
+
+	/** @return RGBA of every pixel of a PNG written by WritePng */
+	std::vector<unsigned char> GetRgba(const PngImage& png) {
+		std::vector<unsigned char> rgba;
+		size_t size = static_cast<size_t>(png.width) * png.height;
+		for (size_t i = 0; i < size; ++i) {
+			const unsigned char* pixel;
+			switch (png.color_type) {
+			case PNG_COLOR_TYPE_GRAY:
+				pixel = &png.data[i];
+				rgba.insert(rgba.end(), { pixel[0], pixel[0], pixel[0], 255 });
+				break;
+			case PNG_COLOR_TYPE_RGB:
+				pixel = &png.data[i * 3];
+				rgba.insert(rgba.end(), { pixel[0], pixel[1], pixel[2], 255 });
+				break;
+			default:
+				pixel = &png.data[i * 4];
+				rgba.insert(rgba.end(), pixel, pixel + 4);
+				break;
+			}
+		}
+		return rgba;
+	}
+
+	int Distance(const unsigned char* a, const unsigned char* b) {
+		int distance = 0;
+		for (int c = 0; c < 3; ++c) {
+			distance += (a[c] - b[c]) * (a[c] - b[c]);
+		}
+		return distance;
+	}
+
+	/**
+	 * Checks the XYZ image png2xyz made from a PNG without palette:
+	 * transparent pixels have index 0, the others the nearest of the
+	 * palette colors 1 to 255. Exact colors stay exact that way.
+	 */
+	bool IsNearestMapping(const PngImage& png, const Image& image) {
+		if (image.width != png.width || image.height != png.height) {
+			return false;
+		}
+		std::vector<unsigned char> rgba = GetRgba(png);
+		for (size_t i = 0; i < image.pixels.size(); ++i) {
+			const unsigned char* pixel = &rgba[i * 4];
+			int index = image.pixels[i];
+			if (pixel[3] == 0 || index == 0) {
+				if (pixel[3] != 0 || index != 0) {
+					return false;
+				}
+				continue;
+			}
+			int distance = Distance(pixel, &image.palette[index * 3]);
+			for (int other = 1; other < 256; ++other) {
+				if (Distance(pixel, &image.palette[other * 3]) < distance) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/** @return the number of different opaque colors of a PNG */
+	size_t CountColors(const PngImage& png) {
+		std::vector<bool> seen(1 << 24);
+		std::vector<unsigned char> rgba = GetRgba(png);
+		size_t colors = 0;
+		for (size_t i = 0; i < rgba.size(); i += 4) {
+			size_t color = rgba[i] | (rgba[i + 1] << 8) | (rgba[i + 2] << 16);
+			if (rgba[i + 3] != 0 && !seen[color]) {
+				seen[color] = true;
+				colors++;
+			}
+		}
+		return colors;
+	}
+
+	/**
+	 * Runs a command in a directory, its output goes to log.txt there.
+	 *
+	 * @return false when it fails
+	 */
+	bool Run(const fs::path& dir, const std::string& command, std::string* log = nullptr) {
+		fs::create_directories(dir);
+		fs::path previous = fs::current_path();
+		fs::current_path(dir);
+		std::cout << "[" << dir.filename().string() << "] " << command << std::endl;
+		int status = std::system((command + " > log.txt 2>&1").c_str());
+		std::vector<unsigned char> output = ReadFile("log.txt");
+		fs::current_path(previous);
+
+		std::string text(output.begin(), output.end());
+		if (log) {
+			*log = text;
+		}
+		if (status != 0) {
+			std::cerr << text;
+		}
+		return status == 0;
+	}
+
+	/** @return the line of the report about a file */
+	std::string GetReport(const std::string& log, const std::string& filename) {
+		size_t start = log.find("Input file " + filename + ":");
+		if (start == std::string::npos) {
+			return "";
+		}
+		return log.substr(start, log.find('\n', start) - start);
+	}
+
+	std::string Quote(const fs::path& path) {
+		return "\"" + path.string() + "\"";
+	}
+
+	/** The XYZ images every xyzcrush case crushes. */
+	const char* const xyz_names[] = { "tiles", "gradient", "noise" };
+
+	/** Writes the XYZ images into dir/in. */
+	std::vector<Image> MakeXyzInputs(const fs::path& dir) {
+		std::vector<Image> images = { MakeTiles(), MakeGradient(), MakeNoise() };
+		fs::create_directories(dir / "in");
+		for (size_t i = 0; i < images.size(); ++i) {
+			Expect(WriteXyz(dir / "in" / (std::string(xyz_names[i]) + ".xyz"), images[i]),
+				std::string("writing ") + xyz_names[i]);
+		}
+		return images;
+	}
+
+	/** @return the input files as arguments, seen from a run directory */
+	std::string XyzInputArguments() {
+		std::string arguments;
+		for (const char* name : xyz_names) {
+			arguments += " " + Quote(fs::path("..") / "in" / (std::string(name) + ".xyz"));
+		}
+		return arguments;
+	}
+
+	/**
+	 * Crushes the XYZ images in dir/run and checks that the output decodes
+	 * to the input.
+	 *
+	 * @param exact palette order and indices must stay, not only the shown
+	 *        pixels
+	 */
+	void CrushAndCompare(const std::string& tool, const fs::path& dir,
+			const std::string& run, const std::string& options, bool exact = true) {
+		std::vector<Image> images = { MakeTiles(), MakeGradient(), MakeNoise() };
+		Expect(Run(dir / run, Quote(tool) + " " + options + XyzInputArguments()),
+			run + ": xyzcrush " + options);
+		for (size_t i = 0; i < images.size(); ++i) {
+			Image output;
+			std::string what = run + ": " + xyz_names[i];
+			if (!ReadXyz(dir / run / (std::string(xyz_names[i]) + ".xyz"), output)) {
+				Expect(false, what + " does not decode");
+			} else if (exact) {
+				Expect(SamePayload(images[i], output), what + " changed");
+			} else {
+				Expect(SameShownPixels(images[i], output), what + " shows other pixels");
+			}
+		}
+	}
+
+	void TestXyzcrushStrategies(const std::string& tool, const fs::path& dir) {
+		MakeXyzInputs(dir);
+		CrushAndCompare(tool, dir, "default", "");
+		const char* strategies[] = { "zopfli", "zopfli-single", "zlib",
+			"zlib-filtered", "zlib-rle", "zlib-huffman" };
+		std::string all;
+		for (const char* strategy : strategies) {
+			CrushAndCompare(tool, dir, strategy, std::string("-x ") + strategy);
+			all += all.empty() ? strategy : std::string(",") + strategy;
+		}
+		CrushAndCompare(tool, dir, "all", "-x " + all);
+	}
+
+	void TestXyzcrushOptions(const std::string& tool, const fs::path& dir) {
+		MakeXyzInputs(dir);
+		CrushAndCompare(tool, dir, "default", "");
+		CrushAndCompare(tool, dir, "reorder", "-r", false);
+		CrushAndCompare(tool, dir, "fixed-point", "-f");
+		CrushAndCompare(tool, dir, "row-matches", "-w 8");
+		CrushAndCompare(tool, dir, "parallel", "-p -s 2 -j 2");
+		CrushAndCompare(tool, dir, "budget", "-b 50");
+		CrushAndCompare(tool, dir, "small-cache", "-m 1");
+		CrushAndCompare(tool, dir, "no-simd", "--no-simd");
+
+		// The SSE2 and AVX2 match search must find the same matches as the
+		// scalar one. The integer costs pick other ties, but the size stays
+		// within a percent of the float costs.
+		for (const char* name : xyz_names) {
+			std::string file = std::string(name) + ".xyz";
+			Expect(ReadFile(dir / "default" / file) == ReadFile(dir / "no-simd" / file),
+				std::string("no-simd: ") + name + " differs from the SIMD result");
+			uintmax_t size = fs::file_size(dir / "default" / file);
+			uintmax_t fixed_size = fs::file_size(dir / "fixed-point" / file);
+			Expect(fixed_size * 100 <= size * 101 && size * 100 <= fixed_size * 101,
+				std::string("fixed-point: ") + name + " differs in size by more than 1%");
+		}
+	}
+
+	void TestXyzcrushIncremental(const std::string& tool, const fs::path& dir) {
+		MakeXyzInputs(dir);
+		CrushAndCompare(tool, dir, "incremental", "-i");
+
+		// A second run starts from the output of the first one and must
+		// decode its stream to the same pixels
+		fs::path second = dir / "second";
+		fs::create_directories(second / "in");
+		for (const char* name : xyz_names) {
+			std::string file = std::string(name) + ".xyz";
+			fs::copy_file(dir / "incremental" / file, second / "in" / file,
+				fs::copy_options::overwrite_existing);
+		}
+		std::vector<Image> images = { MakeTiles(), MakeGradient(), MakeNoise() };
+		Expect(Run(second / "out", Quote(tool) + " -i" + XyzInputArguments()),
+			"second: xyzcrush -i");
+		for (size_t i = 0; i < images.size(); ++i) {
+			std::string file = std::string(xyz_names[i]) + ".xyz";
+			Image output;
+			Expect(ReadXyz(second / "out" / file, output) && SamePayload(images[i], output),
+				std::string("second: ") + xyz_names[i] + " changed");
+			Expect(fs::file_size(second / "out" / file) <= fs::file_size(second / "in" / file),
+				std::string("second: ") + xyz_names[i] + " got larger");
+		}
+	}
+
+	void TestXyzcrushJournal(const std::string& tool, const fs::path& dir) {
+		MakeXyzInputs(dir);
+		fs::path run = dir / "run";
+		std::string tiles = Quote(fs::path("..") / "in" / "tiles.xyz");
+		std::string gradient = Quote(fs::path("..") / "in" / "gradient.xyz");
+		Expect(Run(run, Quote(tool) + " -l journal.txt " + tiles + " " + gradient),
+			"first run with journal");
+
+		// An interrupted write leaves half a line
+		std::ofstream(run / "journal.txt", std::ios::app) << "0123456789abcdef input";
+
+		CrushAndCompare(tool, dir, "run", "-l journal.txt");
+		std::vector<unsigned char> output = ReadFile(run / "log.txt");
+		std::string log(output.begin(), output.end());
+		for (const char* name : { "tiles", "gradient" }) {
+			std::string report = GetReport(log, "../in/" + std::string(name) + ".xyz");
+			Expect(report.find("(journaled)") != std::string::npos,
+				std::string("resumed run crushed ") + name + " again: " + report);
+		}
+		Expect(GetReport(log, "../in/noise.xyz").find("(journaled)") == std::string::npos,
+			"resumed run skipped noise, which it never crushed");
+
+		// Other options make other files
+		Expect(Run(run, Quote(tool) + " -l journal.txt -f " + tiles, &log),
+			"run with journal and other options");
+		Expect(GetReport(log, "../in/tiles.xyz").find("(journaled)") == std::string::npos,
+			"journal skipped a file crushed with other options");
+	}
+
+	void TestXyzcrushCache(const std::string& tool, const fs::path& dir) {
+		MakeXyzInputs(dir);
+		fs::path cache = fs::absolute(dir / "cache.bin");
+		CrushAndCompare(tool, dir, "first", "-c " + Quote(cache));
+		CrushAndCompare(tool, dir, "second", "-c " + Quote(cache));
+
+		std::vector<unsigned char> output = ReadFile(dir / "second" / "log.txt");
+		std::string log(output.begin(), output.end());
+		for (const char* name : xyz_names) {
+			std::string file = std::string(name) + ".xyz";
+			Expect(GetReport(log, "../in/" + file).find("(cached)") != std::string::npos,
+				std::string("cache missed ") + name);
+			Expect(ReadFile(dir / "first" / file) == ReadFile(dir / "second" / file),
+				std::string("cached result of ") + name + " differs");
+		}
+	}
+
+	/**
+	 * Converts the PNG images with png2xyz and with png2xyz --crush.
+	 *
+	 * @param check checks the XYZ image of a PNG
+	 */
+	template <typename Check>
+	void ConvertAndCheck(const std::string& tool, const fs::path& dir,
+			const std::vector<std::pair<std::string, PngImage>>& pngs, Check check) {
+		std::string arguments;
+		fs::create_directories(dir / "in");
+		for (const auto& png : pngs) {
+			Expect(WritePng(dir / "in" / (png.first + ".png"), png.second),
+				"writing " + png.first);
+			arguments += " " + Quote(fs::path("..") / "in" / (png.first + ".png"));
+		}
+		Expect(Run(dir / "zlib", Quote(tool) + arguments), "png2xyz");
+		Expect(Run(dir / "crush", Quote(tool) + " --crush" + arguments), "png2xyz --crush");
+
+		for (const auto& png : pngs) {
+			Image image;
+			Image crushed;
+			std::string file = png.first + ".xyz";
+			if (!ReadXyz(dir / "zlib" / file, image) || !ReadXyz(dir / "crush" / file, crushed)) {
+				Expect(false, png.first + " does not decode");
+				continue;
+			}
+			Expect(check(png.second, image), png.first + " does not show the PNG");
+			Expect(SamePayload(image, crushed), png.first + " changed with --crush");
+		}
+	}
+
+	void TestPng2xyzPalette(const std::string& tool, const fs::path& dir) {
+		Image tiles = MakeTiles();
+		Image gradient = MakeGradient();
+		std::vector<std::pair<std::string, PngImage>> pngs = {
+			{ "gradient", MakePalettePng(gradient, 201, 8, false) },
+			{ "gradient_interlaced", MakePalettePng(gradient, 256, 8, true) },
+			{ "tiles4", MakePalettePng(tiles, 16, 4, false) },
+			{ "tiles4_interlaced", MakePalettePng(tiles, 16, 4, true) }
+		};
+
+		// Palette and indices are kept, the palette is filled up with black
+		ConvertAndCheck(tool, dir, pngs, [](const PngImage& png, const Image& image) {
+			std::vector<unsigned char> palette(768);
+			for (size_t i = 0; i < png.palette.size(); ++i) {
+				palette[i * 3] = png.palette[i].red;
+				palette[i * 3 + 1] = png.palette[i].green;
+				palette[i * 3 + 2] = png.palette[i].blue;
+			}
+			return image.width == png.width && image.height == png.height &&
+				image.palette == palette && image.pixels == png.data;
+		});
+	}
+
+	void TestPng2xyzTruecolor(const std::string& tool, const fs::path& dir) {
+		std::vector<std::pair<std::string, PngImage>> pngs = {
+			{ "tiles_rgba", MakeRgbaPng(MakeTiles()) },
+			{ "gradient_rgba", MakeRgbaPng(MakeGradient()) },
+			{ "gray_interlaced", MakeGrayPng() },
+			{ "truecolor", MakeTruecolorPng() }
+		};
+		Expect(CountColors(pngs.back().second) > 255, "truecolor has too few colors");
+
+		ConvertAndCheck(tool, dir, pngs, IsNearestMapping);
+	}
+
+	struct TestCase {
+		const char* name;
+		void (*run)(const std::string& tool, const fs::path& dir);
+	};
+
+	const TestCase test_cases[] = {
+		{ "xyzcrush-strategies", TestXyzcrushStrategies },
+		{ "xyzcrush-options", TestXyzcrushOptions },
+		{ "xyzcrush-incremental", TestXyzcrushIncremental },
+		{ "xyzcrush-journal", TestXyzcrushJournal },
+		{ "xyzcrush-cache", TestXyzcrushCache },
+		{ "png2xyz-palette", TestPng2xyzPalette },
+		{ "png2xyz-truecolor", TestPng2xyzTruecolor }
+	};
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " CASE TOOL" << std::endl;
+		return 2;
+	}
+	std::string name = argv[1];
+	std::string tool = fs::absolute(argv[2]).string();
+
+	for (const TestCase& test_case : test_cases) {
+		if (name == test_case.name) {
+			fs::path dir = fs::absolute(name);
+			fs::remove_all(dir);
+			fs::create_directories(dir);
+			test_case.run(tool, dir);
+			if (failures > 0) {
+				std::cerr << failures << " checks failed." << std::endl;
+				return 1;
+			}
+			return 0;
+		}
+	}
+	std::cerr << "Unknown test case " << name << "." << std::endl;
+	return 2;
+}
@@ -19,12 +19,12 @@
 #include <png.h>
 #include <cstring>
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <sstream>
 #ifdef _WIN32
 # include <algorithm>
 #endif
+#include "mapped_file.h"
 
 # ifdef __MINGW64_VERSION_MAJOR
 int _dowildcard = -1; /* enable wildcard expansion for mingw-w64 */
@@ -84,46 +84,45 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	// Reused for all files, they keep the size of the largest one
+	MappedFile file;
+	std::vector<Bytef> xyz_data;
+	std::vector<png_bytep> row_pointers;
+
 	for(int arg = 1; arg < argc; arg++) {
-		std::ifstream file(argv[arg],
-			std::ios::binary | std::ios::ate);
-		if(!file) {
+		if(!file.Open(argv[arg])) {
 			std::cerr << "Error reading file "
 				<< argv[arg] << "." << std::endl;
 			return 1;
 		}
 
-		long size = file.tellg();
-		char* header = new char[4];
+		const unsigned char* file_data = file.GetData();
+		size_t size = file.GetSize();
 
-		file.seekg(0, std::ios::beg);
-		file.read((char*) header, 4);
-		if(memcmp(header, "XYZ1", 4) != 0) {
+		if(size < 8 || memcmp(file_data, "XYZ1", 4) != 0) {
+			std::string header(reinterpret_cast<const char*>(file_data),
+				size < 4 ? size : 4);
 			std::cerr << "Input file " << argv[arg]
 				<< " is not a XYZ file: '"
 				<< header << "'." << std::endl;
-			delete[] header;
 			return 1;
 		}
-		delete[] header;
 
 		unsigned short width;
 		unsigned short height;
-		file.read((char*) &width, 2);
-		file.read((char*) &height, 2);
-
-		int compressed_xyz_size = size - 8;
-		Bytef* compressed_xyz_data = new Bytef[compressed_xyz_size];
+		memcpy(&width, file_data + 4, 2);
+		memcpy(&height, file_data + 6, 2);
 
-		file.read((char*) compressed_xyz_data, compressed_xyz_size);
+		const Bytef* compressed_xyz_data = file_data + 8;
+		uLong compressed_xyz_size = static_cast<uLong>(size - 8);
 
 		uLongf xyz_size = 768 + (width * height);
-		std::vector<Bytef> xyz_data(
-			xyz_size);
+		xyz_data.resize(xyz_size);
 
 		int status = uncompress(&xyz_data.front(),
 			&xyz_size, compressed_xyz_data,
 			compressed_xyz_size);
+		file.Close();
 
 		if(status != Z_OK) {
 			std::cerr << "Error uncompressing XYZ file "
@@ -220,13 +219,12 @@ int main(int argc, char* argv[]) {
 
 		png_write_info(png_ptr, info_ptr);
 
-		png_bytep* row_pointers = new png_bytep[height];
+		row_pointers.resize(height);
 		for(int i = 0; i < height; i++) {
 			row_pointers[i] =
 				&xyz_data[768 + width * i];
 		}
-		png_write_image(png_ptr, row_pointers);
-		delete[] row_pointers;
+		png_write_image(png_ptr, row_pointers.data());
 	
 		png_write_end(png_ptr, info_ptr);
 
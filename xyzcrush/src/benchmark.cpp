@@ -0,0 +1,639 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2017 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compresses a synthetic corpus of XYZ image payloads with a matrix of Zopfli
+ * options and prints size, time and memory of every run as JSON. The corpus
+ * is generated from fixed seeds, so results of different builds compare.
+ */
+
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <argparse.hpp>
+#include "json.h"
+#include "warmstart.h"
+#include "worker_pool.h"
+#include "zlib_container.h"
+#include "zopfli_callbacks.h"
+
+namespace {
+
+/** Small deterministic generator, the corpus must not depend on the libc. */
+class Random {
+public:
+	explicit Random(uint32_t seed) : state(seed ? seed : 0x9E3779B9u) {}
+
+	uint32_t Next() {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	/** Returns a number from 0 to n - 1. */
+	int Below(int n) {
+		return static_cast<int>(Next() % static_cast<uint32_t>(n));
+	}
+
+private:
+	uint32_t state;
+};
+
+/** An image of the corpus, payload is palette and pixels like in a XYZ file. */
+struct BenchImage {
+	std::string name;
+	std::string kind;
+	int width;
+	int height;
+	std::vector<unsigned char> payload;
+	/**
+	 * zlib level 9 stream of the payload, what Estimate is calibrated against
+	 * and what the warm start reads
+	 */
+	std::vector<unsigned char> zlib_stream;
+
+	unsigned char* Pixels() {
+		return payload.data() + 768;
+	}
+};
+
+/** Fills the palette with ramps of 8 shades, entry 0 stays black. */
+void MakePalette(BenchImage& image, Random& random) {
+	for (int ramp = 0; ramp < 32; ++ramp) {
+		int r = random.Below(256), g = random.Below(256), b = random.Below(256);
+		for (int shade = 0; shade < 8; ++shade) {
+			int index = ramp * 8 + shade;
+			if (index == 0) {
+				continue;
+			}
+			image.payload[index * 3] = static_cast<unsigned char>(r * (shade + 1) / 8);
+			image.payload[index * 3 + 1] = static_cast<unsigned char>(g * (shade + 1) / 8);
+			image.payload[index * 3 + 2] = static_cast<unsigned char>(b * (shade + 1) / 8);
+		}
+	}
+}
+
+/**
+ * Returns sin(2 * pi * angle / 4096) * 1024. The table keeps the corpus free
+ * of floating point functions, whose last bits differ between libms.
+ */
+int Sine(long angle) {
+	static const int quarter[17] = { 0, 100, 200, 297, 392, 483, 569, 650, 724,
+		792, 851, 903, 946, 980, 1004, 1019, 1024 };
+	angle &= 4095;
+	long quadrant = angle / 1024;
+	long pos = angle % 1024;
+	if (quadrant % 2 == 1) {
+		pos = 1024 - pos;
+	}
+	long i = pos / 64;
+	int value = quarter[i];
+	if (i < 16) {
+		value += static_cast<int>((quarter[i + 1] - quarter[i]) * (pos % 64) / 64);
+	}
+	return quadrant >= 2 ? -value : value;
+}
+
+/** Returns the 4x4 ordered dither threshold of a pixel, from 0 to 15. */
+int Bayer(int x, int y) {
+	static const int matrix[16] = { 0, 8, 2, 10, 12, 4, 14, 6, 3, 11, 1, 9, 15, 7, 13, 5 };
+	return matrix[(y & 3) * 4 + (x & 3)];
+}
+
+/** A chipset: 16x16 tiles from a small set, some of them mirrored. */
+void DrawTileset(BenchImage& image, Random& random) {
+	const int tile_size = 16;
+	const int tile_count = 32;
+	std::vector<unsigned char> tiles(tile_count * tile_size * tile_size);
+	for (int t = 0; t < tile_count; ++t) {
+		unsigned char* tile = &tiles[t * tile_size * tile_size];
+		int base = (1 + random.Below(31)) * 8;
+		int pattern = random.Below(4);
+		for (int y = 0; y < tile_size; ++y) {
+			for (int x = 0; x < tile_size; ++x) {
+				int shade = 3;
+				switch (pattern) {
+				case 0: // grass: plain with specks
+					shade = random.Below(10) == 0 ? 1 + random.Below(7) : 3;
+					break;
+				case 1: // bricks
+					shade = (y % 4 == 3 || (x + (y / 4 % 2) * 4) % 8 == 0) ? 1 : 5;
+					break;
+				case 2: // checker
+					shade = ((x / 4 + y / 4) % 2) ? 2 : 6;
+					break;
+				default: // shaded slope
+					shade = (x + y) / 4 % 8;
+					break;
+				}
+				tile[y * tile_size + x] = static_cast<unsigned char>(base + shade);
+			}
+		}
+	}
+
+	unsigned char* pixels = image.Pixels();
+	for (int ty = 0; ty < image.height; ty += tile_size) {
+		for (int tx = 0; tx < image.width; tx += tile_size) {
+			const unsigned char* tile = &tiles[random.Below(tile_count) * tile_size * tile_size];
+			bool mirror = random.Below(4) == 0;
+			for (int y = 0; y < tile_size && ty + y < image.height; ++y) {
+				for (int x = 0; x < tile_size && tx + x < image.width; ++x) {
+					int sx = mirror ? tile_size - 1 - x : x;
+					pixels[(ty + y) * image.width + tx + x] = tile[y * tile_size + sx];
+				}
+			}
+		}
+	}
+}
+
+/** A charset: 24x32 sprites of 8 characters in 3 frames and 4 directions. */
+void DrawCharset(BenchImage& image, Random& random) {
+	const int cell_width = 24;
+	const int cell_height = 32;
+	struct Character {
+		int hair, skin, cloth, legs;
+	} characters[8];
+	for (auto& c : characters) {
+		c.hair = (1 + random.Below(31)) * 8 + 2;
+		c.skin = (1 + random.Below(31)) * 8 + 6;
+		c.cloth = (1 + random.Below(31)) * 8 + 4;
+		c.legs = (1 + random.Below(31)) * 8 + 1;
+	}
+
+	unsigned char* pixels = image.Pixels();
+	for (int cy = 0; cy * cell_height < image.height; ++cy) {
+		for (int cx = 0; cx * cell_width < image.width; ++cx) {
+			const Character& c = characters[(cx / 3 + cy / 4 * 4) % 8];
+			int frame = cx % 3 - 1;
+			int direction = cy % 4;
+			for (int y = 0; y < cell_height; ++y) {
+				for (int x = 0; x < cell_width; ++x) {
+					int px = cx * cell_width + x;
+					int py = cy * cell_height + y;
+					if (px >= image.width || py >= image.height) {
+						continue;
+					}
+					int dx = x - 12, dy = y - 10;
+					int color = 0;
+					if (dx * dx + dy * dy <= 49) {
+						// Facing away shows only hair, else the face below it
+						color = (direction == 3 || y < 7) ? c.hair : c.skin;
+						if (direction == 0 && y == 11 && (x == 9 || x == 15)) {
+							color = 8;
+						}
+					} else if (y >= 17 && y < 27 && x >= 6 && x < 18) {
+						color = c.cloth;
+					} else if (y >= 27 && y < 31) {
+						int leg_x = x - frame * (y - 26) / 2;
+						if ((leg_x >= 7 && leg_x < 11) || (leg_x >= 13 && leg_x < 17)) {
+							color = c.legs;
+						}
+					}
+					pixels[py * image.width + px] = static_cast<unsigned char>(color);
+				}
+			}
+		}
+	}
+}
+
+/** A diagonal gradient through 64 colors with ordered dithering. */
+void DrawGradient(BenchImage& image, Random& random) {
+	int a = 1 + random.Below(4), b = 1 + random.Below(4);
+	long range = static_cast<long>(image.width) * a + static_cast<long>(image.height) * b;
+	unsigned char* pixels = image.Pixels();
+	for (int y = 0; y < image.height; ++y) {
+		for (int x = 0; x < image.width; ++x) {
+			long value = (static_cast<long>(x) * a + static_cast<long>(y) * b) * 63 * 16 / range;
+			int index = static_cast<int>(value / 16) + ((value % 16) > Bayer(x, y) ? 1 : 0);
+			pixels[y * image.width + x] = static_cast<unsigned char>(8 + std::min(index, 63));
+		}
+	}
+}
+
+/** Random colors, the worst case for any compressor. */
+void DrawNoise(BenchImage& image, Random& random) {
+	unsigned char* pixels = image.Pixels();
+	for (int i = 0; i < image.width * image.height; ++i) {
+		pixels[i] = static_cast<unsigned char>(random.Below(256));
+	}
+}
+
+/** A background: dithered sky, clouds and textured mountains. */
+void DrawPanorama(BenchImage& image, Random& random) {
+	// Angles in 1/4096 of a turn
+	long phase[3];
+	for (long& p : phase) {
+		p = random.Below(4096);
+	}
+	struct Cloud {
+		int x, y, rx, ry;
+	};
+	std::vector<Cloud> clouds(6);
+	for (auto& cloud : clouds) {
+		cloud.rx = image.width / 16 + random.Below(image.width / 8 + 1);
+		cloud.ry = cloud.rx / 4 + 1;
+		cloud.x = random.Below(image.width);
+		cloud.y = random.Below(image.height / 3 + 1);
+	}
+
+	unsigned char* pixels = image.Pixels();
+	for (int x = 0; x < image.width; ++x) {
+		// About 1.1, 3 and 8.4 turns over the width, in 1/1000 of the height
+		long ridge = 450 * 1024
+			+ 120 * Sine(x * 4563L / image.width + phase[0])
+			+ 60 * Sine(x * 12386L / image.width + phase[1])
+			+ 20 * Sine(x * 34551L / image.width + phase[2]);
+		int ridge_y = static_cast<int>(ridge * image.height / (1000 * 1024));
+		for (int y = 0; y < image.height; ++y) {
+			int color;
+			if (y >= ridge_y) {
+				// Rock gets darker with depth and has a little grain
+				int depth = (y - ridge_y) * 8 / (image.height - ridge_y + 1);
+				color = 128 + std::min(7, depth + (random.Below(8) == 0 ? 1 : 0));
+			} else {
+				int value = y * 31 * 16 / (image.height + 1);
+				color = 40 + value / 16 + ((value % 16) > Bayer(x, y) ? 1 : 0);
+				for (const auto& cloud : clouds) {
+					long dx = x - cloud.x, dy = y - cloud.y;
+					if (dx * dx * cloud.ry * cloud.ry + dy * dy * cloud.rx * cloud.rx
+							<= static_cast<long>(cloud.rx) * cloud.rx * cloud.ry * cloud.ry) {
+						color = dy > 0 ? 254 : 255;
+					}
+				}
+			}
+			pixels[y * image.width + x] = static_cast<unsigned char>(color);
+		}
+	}
+}
+
+struct CorpusKind {
+	const char* name;
+	int width;
+	int height;
+	void (*draw)(BenchImage&, Random&);
+};
+
+const CorpusKind corpus_kinds[] = {
+	{ "tileset", 480, 256, DrawTileset },
+	{ "charset", 288, 256, DrawCharset },
+	{ "gradient", 320, 240, DrawGradient },
+	{ "noise", 160, 120, DrawNoise },
+	{ "panorama", 640, 480, DrawPanorama },
+};
+
+struct CorpusSize {
+	const char* name;
+	int numerator;
+	int denominator;
+};
+
+const CorpusSize corpus_sizes[] = {
+	{ "small", 1, 2 },
+	{ "medium", 1, 1 },
+	{ "large", 2, 1 },
+};
+
+/** Compression settings of one column of the matrix. */
+struct BenchConfig {
+	int iterations;
+	int split_max;
+	std::string mode;
+};
+
+const char* const modes[] = { "plain", "fixed-point", "row-matches", "fast", "scalar",
+	"seeds", "parallel", "small-cache", "warm-start" };
+
+/**
+ * Applies config to options, the row width is the one of the image. The
+ * warm start is set up by the caller.
+ */
+void ApplyConfig(const BenchConfig& config, int width, WorkerPool& pool,
+		ZopfliOptions& options) {
+	ZopfliInitOptions(&options);
+	options.numiterations = config.iterations;
+	options.blocksplittingmax = config.split_max;
+	bool fixed_point = config.mode == "fixed-point" || config.mode == "fast";
+	bool row_matches = config.mode == "row-matches" || config.mode == "fast";
+	options.fixedpointcosts = fixed_point;
+	// Same as plain, but without SSE2 or AVX2 in the match search
+	options.scalarmatch = config.mode == "scalar";
+	if (row_matches) {
+		// Same as xyzcrush --row-matches 32
+		options.maxchainhits = 32;
+		options.rowwidth = width;
+	}
+	if (config.mode == "seeds" || config.mode == "parallel") {
+		options.runjobs = RunZopfliJobs;
+		options.runjobs_context = &pool;
+	}
+	if (config.mode == "seeds") {
+		// Same as xyzcrush --seeds 4
+		options.numseeds = 4;
+	} else if (config.mode == "parallel") {
+		// Same as xyzcrush --parallel-blocks
+		options.speculativesplit = 1;
+	} else if (config.mode == "small-cache") {
+		// Same as xyzcrush --match-cache-mb 1
+		options.maxcachesize = 1024 * 1024;
+	}
+}
+
+/**
+ * Forgets the peak memory so far. Only Linux allows this, other platforms
+ * only know the peak of the whole process, which says nothing about a run.
+ *
+ * @return whether GetPeakMemory measures from now on
+ */
+bool ResetPeakMemory() {
+#if defined(__linux__)
+	std::ofstream clear_refs("/proc/self/clear_refs");
+	return clear_refs && (clear_refs << "5") && clear_refs.flush();
+#else
+	return false;
+#endif
+}
+
+/** Returns the peak memory use in bytes since the last ResetPeakMemory. */
+size_t GetPeakMemory() {
+#if defined(__linux__)
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return static_cast<size_t>(std::strtoull(line.c_str() + 6, nullptr, 10)) * 1024;
+		}
+	}
+#endif
+	return 0;
+}
+
+/** Returns a byte count as JSON, null when it was not measured. */
+std::string JsonBytes(bool measured, size_t bytes) {
+	return measured ? std::to_string(bytes) : "null";
+}
+
+/** Returns whether zlib decodes stream back to payload. */
+bool CheckStream(const unsigned char* stream, size_t size, const std::vector<unsigned char>& payload) {
+	std::vector<unsigned char> decoded(payload.size());
+	uLongf decoded_size = static_cast<uLongf>(decoded.size());
+	if (uncompress(decoded.data(), &decoded_size, stream, static_cast<uLong>(size)) != Z_OK) {
+		return false;
+	}
+	return decoded_size == payload.size() && decoded == payload;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	std::vector<int> iterations = { 5, 15 };
+	std::vector<int> split_max = { 15 };
+	std::vector<std::string> mode_names(std::begin(modes), std::end(modes));
+	std::vector<std::string> size_names = { "small", "medium" };
+	std::vector<std::string> kind_names;
+	for (const auto& kind : corpus_kinds) {
+		kind_names.push_back(kind.name);
+	}
+	int jobs = static_cast<int>(WorkerPool::GetDefaultThreadCount());
+	std::string output_file;
+
+	argparse::ArgumentParser cli("xyzcrush-benchmark", PACKAGE_VERSION);
+	cli.set_usage_max_line_width(100);
+	cli.add_description("Compresses a generated corpus of XYZ images with a matrix of\n"
+		"Zopfli options and prints size, time and memory of each run as JSON.");
+	cli.add_epilog("Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
+
+	cli.add_argument("-i", "--iterations").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(iterations).help("Iteration counts to run (default: 5 15)").metavar("N");
+	cli.add_argument("-b", "--split-max").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(split_max).help("Maximum block counts to run (default: 15)").metavar("N");
+	cli.add_argument("-m", "--modes").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(mode_names)
+		.help("Modes to run: plain, fixed-point, row-matches, fast,\n"
+			"which is both of the former, scalar, which is plain\n"
+			"without SIMD match search, seeds (4 seeds), parallel\n"
+			"(parallel blocks and split probes), small-cache (1 MB\n"
+			"match cache) and warm-start (from a zlib level 9 stream,\n"
+			"decoded in the measured time) (default: all)").metavar("MODE");
+	cli.add_argument("-s", "--sizes").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(size_names)
+		.help("Image sizes: small, medium and large (default: small medium)")
+		.metavar("SIZE");
+	cli.add_argument("-k", "--kinds").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(kind_names)
+		.help("Images: tileset, charset, gradient, noise and panorama\n"
+			"(default: all)").metavar("KIND");
+	cli.add_argument("-j", "--jobs").store_into(jobs)
+		.help("Threads of the seeds and parallel modes\n"
+			"(default: number of hardware threads)").metavar("N");
+	cli.add_argument("-o", "--output").store_into(output_file)
+		.help("Write the JSON into FILE instead of stdout").metavar("FILE");
+
+	try {
+		cli.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << std::endl;
+		std::cerr << cli.usage() << std::endl;
+		return 1;
+	}
+
+	for (int value : iterations) {
+		if (value < 1) {
+			std::cerr << "--iterations must be at least 1." << std::endl;
+			return 1;
+		}
+	}
+	for (int value : split_max) {
+		if (value < 0) {
+			std::cerr << "--split-max must not be negative." << std::endl;
+			return 1;
+		}
+	}
+	if (jobs < 1) {
+		std::cerr << "--jobs must be at least 1." << std::endl;
+		return 1;
+	}
+	for (const auto& name : mode_names) {
+		if (std::find(std::begin(modes), std::end(modes), name) == std::end(modes)) {
+			std::cerr << "Unknown mode " << name << "." << std::endl;
+			return 1;
+		}
+	}
+
+	// Every image has its own seed, so a subset of the corpus stays the same
+	std::vector<BenchImage> corpus;
+	for (const auto& size_name : size_names) {
+		auto size = std::find_if(std::begin(corpus_sizes), std::end(corpus_sizes),
+			[&size_name](const CorpusSize& s) { return size_name == s.name; });
+		if (size == std::end(corpus_sizes)) {
+			std::cerr << "Unknown size " << size_name << "." << std::endl;
+			return 1;
+		}
+		for (const auto& kind_name : kind_names) {
+			auto kind = std::find_if(std::begin(corpus_kinds), std::end(corpus_kinds),
+				[&kind_name](const CorpusKind& k) { return kind_name == k.name; });
+			if (kind == std::end(corpus_kinds)) {
+				std::cerr << "Unknown kind " << kind_name << "." << std::endl;
+				return 1;
+			}
+			BenchImage image;
+			image.kind = kind->name;
+			image.name = image.kind + "-" + size->name;
+			image.width = kind->width * size->numerator / size->denominator;
+			image.height = kind->height * size->numerator / size->denominator;
+			image.payload.assign(768 + image.width * image.height, 0);
+			uint32_t seed = static_cast<uint32_t>((kind - std::begin(corpus_kinds)) * 7919
+				+ (size - std::begin(corpus_sizes)) * 104729 + 1);
+			Random random(seed);
+			MakePalette(image, random);
+			kind->draw(image, random);
+			uLongf zlib_size = compressBound(static_cast<uLong>(image.payload.size()));
+			image.zlib_stream.resize(zlib_size);
+			compress2(image.zlib_stream.data(), &zlib_size, image.payload.data(),
+				static_cast<uLong>(image.payload.size()), Z_BEST_COMPRESSION);
+			image.zlib_stream.resize(zlib_size);
+			corpus.push_back(std::move(image));
+		}
+	}
+
+	std::vector<BenchConfig> configs;
+	for (int i : iterations) {
+		for (int b : split_max) {
+			for (const auto& mode : mode_names) {
+				configs.push_back({ i, b, mode });
+			}
+		}
+	}
+
+	struct Totals {
+		size_t input_bytes = 0;
+		size_t bytes = 0;
+		double wall_ms = 0;
+		double cpu_ms = 0;
+		size_t peak_rss = 0;
+		bool has_peak_rss = true;
+	};
+	std::vector<Totals> totals(configs.size());
+	bool all_valid = true;
+	WorkerPool pool(static_cast<unsigned>(jobs));
+
+	std::ostringstream json;
+	json << "{\n  \"version\": " << JsonString(PACKAGE_VERSION) << ",\n  \"runs\": [";
+	bool first = true;
+	for (size_t c = 0; c < configs.size(); ++c) {
+		const BenchConfig& config = configs[c];
+		for (const auto& image : corpus) {
+			ZopfliOptions options;
+			ApplyConfig(config, image.width, pool, options);
+
+			std::cerr << image.name << " i" << config.iterations << " b" << config.split_max
+				<< " " << config.mode << std::endl;
+
+			unsigned char* out = nullptr;
+			size_t out_size = 0;
+			bool has_peak_rss = ResetPeakMemory();
+			auto wall_start = std::chrono::steady_clock::now();
+			std::clock_t cpu_start = std::clock();
+			ZopfliWarmStart warm;
+			bool warm_start = config.mode == "warm-start" &&
+				ZopfliInitWarmStart(image.zlib_stream.data(), image.zlib_stream.size(),
+					image.payload.data(), image.payload.size(), &warm);
+			if (warm_start) {
+				options.warmstart = &warm;
+			}
+			ZopfliZlibCompress(&options, image.payload.data(), image.payload.size(), &out, &out_size);
+			if (warm_start) {
+				ZopfliCleanWarmStart(&warm);
+			}
+			std::clock_t cpu_end = std::clock();
+			auto wall_end = std::chrono::steady_clock::now();
+			size_t peak_rss = GetPeakMemory();
+
+			bool valid = CheckStream(out, out_size, image.payload);
+			free(out);
+			if (!valid) {
+				std::cerr << "Output of " << image.name << " does not decode to the input." << std::endl;
+				all_valid = false;
+			}
+
+			double wall_ms = std::chrono::duration<double, std::milli>(wall_end - wall_start).count();
+			double cpu_ms = 1000.0 * (cpu_end - cpu_start) / CLOCKS_PER_SEC;
+			Totals& total = totals[c];
+			total.input_bytes += image.payload.size();
+			total.bytes += out_size;
+			total.wall_ms += wall_ms;
+			total.cpu_ms += cpu_ms;
+			total.peak_rss = std::max(total.peak_rss, peak_rss);
+			total.has_peak_rss = total.has_peak_rss && has_peak_rss;
+
+			json << (first ? "\n" : ",\n") << "    {"
+				<< "\"image\": " << JsonString(image.name)
+				<< ", \"kind\": " << JsonString(image.kind)
+				<< ", \"width\": " << image.width
+				<< ", \"height\": " << image.height
+				<< ", \"iterations\": " << config.iterations
+				<< ", \"split_max\": " << config.split_max
+				<< ", \"mode\": " << JsonString(config.mode)
+				<< ", \"input_bytes\": " << image.payload.size()
+				<< ", \"zlib_bytes\": " << image.zlib_stream.size()
+				<< ", \"bytes\": " << out_size
+				<< ", \"ratio\": " << static_cast<double>(out_size) / image.payload.size()
+				<< ", \"wall_ms\": " << wall_ms
+				<< ", \"cpu_ms\": " << cpu_ms
+				<< ", \"peak_rss\": " << JsonBytes(has_peak_rss, peak_rss)
+				<< ", \"valid\": " << (valid ? "true" : "false") << "}";
+			first = false;
+		}
+	}
+	json << "\n  ],\n  \"totals\": [";
+	for (size_t c = 0; c < configs.size(); ++c) {
+		const Totals& total = totals[c];
+		json << (c == 0 ? "\n" : ",\n") << "    {"
+			<< "\"iterations\": " << configs[c].iterations
+			<< ", \"split_max\": " << configs[c].split_max
+			<< ", \"mode\": " << JsonString(configs[c].mode)
+			<< ", \"input_bytes\": " << total.input_bytes
+			<< ", \"bytes\": " << total.bytes
+			<< ", \"ratio\": " << (total.input_bytes ? static_cast<double>(total.bytes) / total.input_bytes : 0.0)
+			<< ", \"wall_ms\": " << total.wall_ms
+			<< ", \"cpu_ms\": " << total.cpu_ms
+			<< ", \"peak_rss\": " << JsonBytes(total.has_peak_rss, total.peak_rss) << "}";
+	}
+	json << "\n  ]\n}\n";
+
+	if (output_file.empty()) {
+		std::cout << json.str();
+	} else {
+		std::ofstream out(output_file, std::ios::binary);
+		out << json.str();
+		if (!out) {
+			std::cerr << "Could not write " << output_file << "." << std::endl;
+			return 1;
+		}
+	}
+
+	return all_valid ? 0 : 2;
+}
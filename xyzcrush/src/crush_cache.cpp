@@ -0,0 +1,133 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "crush_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+namespace {
+	const char magic[8] = { 'X', 'Y', 'Z', 'C', 'A', 'C', 'H', '1' };
+
+	uint64_t ReadLE(const unsigned char* p, int bytes) {
+		uint64_t value = 0;
+		for (int i = bytes - 1; i >= 0; --i) {
+			value = (value << 8) | p[i];
+		}
+		return value;
+	}
+
+	void WriteLE(unsigned char* p, uint64_t value, int bytes) {
+		for (int i = 0; i < bytes; ++i) {
+			p[i] = static_cast<unsigned char>(value >> (8 * i));
+		}
+	}
+
+	uint64_t Fnv1a(uint64_t hash, const unsigned char* data, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= data[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+}
+
+bool CrushCache::Open(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::ifstream in(filename, std::ios::binary);
+	bool empty = true;
+	if (in) {
+		std::vector<unsigned char> content((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+		if (!content.empty()) {
+			if (content.size() < sizeof(magic) ||
+					memcmp(content.data(), magic, sizeof(magic)) != 0) {
+				return false;
+			}
+			empty = false;
+		}
+
+		size_t pos = sizeof(magic);
+		while (pos + 12 <= content.size()) {
+			size_t record = pos;
+			uint64_t key = ReadLE(&content[pos], 8);
+			size_t length = static_cast<size_t>(ReadLE(&content[pos + 8], 4));
+			pos += 12;
+			if (length > content.size() - pos) {
+				pos = record;
+				break;
+			}
+			entries[key].assign(content.begin() + pos, content.begin() + pos + length);
+			pos += length;
+		}
+		in.close();
+
+		// Drop a cut off record, new records would be appended to it
+		if (!empty && pos != content.size()) {
+			std::error_code ec;
+			std::filesystem::resize_file(filename, pos, ec);
+			if (ec) {
+				return false;
+			}
+		}
+	}
+
+	file.open(filename, std::ios::binary | std::ios::app);
+	if (!file) {
+		return false;
+	}
+	if (empty) {
+		file.write(magic, sizeof(magic));
+		file.flush();
+	}
+	return true;
+}
+
+bool CrushCache::Find(uint64_t key, std::vector<unsigned char>& stream) const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		return false;
+	}
+	stream = it->second;
+	return true;
+}
+
+void CrushCache::Store(uint64_t key, const unsigned char* data, size_t size) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	entries[key].assign(data, data + size);
+
+	unsigned char header[12];
+	WriteLE(header, key, 8);
+	WriteLE(header + 8, size, 4);
+	file.write(reinterpret_cast<char*>(header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(data), size);
+	// Keep the file usable when the run gets interrupted
+	file.flush();
+}
+
+uint64_t CrushCache::MakeKey(const unsigned char* data, size_t size,
+		const std::string& options) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	hash = Fnv1a(hash, data, size);
+	return Fnv1a(hash, reinterpret_cast<const unsigned char*>(options.data()),
+		options.size());
+}
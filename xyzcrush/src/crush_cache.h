@@ -0,0 +1,86 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_CRUSH_CACHE
+#define XYZCRUSH_CRUSH_CACHE
+
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * On-disk store of the best compressed stream found for an XYZ payload.
+ *
+ * The file starts with a magic and is followed by records of a 64 bit key,
+ * a 32 bit length and the zlib stream (all little endian). New results are
+ * appended, so a later record of the same key replaces an earlier one and a
+ * record cut off by an interrupted run is ignored on load.
+ *
+ * The key is only a hash, callers must check that a returned stream really
+ * decodes to their payload.
+ *
+ * All methods may be called from several threads.
+ */
+class CrushCache {
+public:
+	/**
+	 * Reads the cache file and opens it for appending. A missing file is
+	 * created.
+	 *
+	 * @param filename cache file
+	 * @return false when the file cannot be used as cache
+	 */
+	bool Open(const std::string& filename);
+
+	/**
+	 * @param key result of MakeKey
+	 * @param stream receives the cached stream
+	 * @return true when the key was found
+	 */
+	bool Find(uint64_t key, std::vector<unsigned char>& stream) const;
+
+	/**
+	 * Stores a stream for the key and appends it to the file.
+	 *
+	 * @param key result of MakeKey
+	 * @param data zlib stream
+	 * @param size length of data
+	 */
+	void Store(uint64_t key, const unsigned char* data, size_t size);
+
+	/**
+	 * Hashes (FNV-1a) the payload together with the options it was
+	 * compressed with.
+	 *
+	 * @param data decompressed XYZ payload
+	 * @param size length of data
+	 * @param options text describing all options that influence the stream
+	 * @return cache key
+	 */
+	static uint64_t MakeKey(const unsigned char* data, size_t size,
+		const std::string& options);
+
+private:
+	std::unordered_map<uint64_t, std::vector<unsigned char>> entries;
+	std::ofstream file;
+	mutable std::mutex mutex;
+};
+
+#endif
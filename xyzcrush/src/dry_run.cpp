@@ -0,0 +1,209 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dry_run.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include "estimate.h"
+#include "json.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+	/** Prediction for one file, or why there is none */
+	struct FileEstimate {
+		std::string folder;
+		size_t bytes = 0;
+		size_t payload_bytes = 0;
+		size_t projected_bytes = 0;
+		std::string error;
+	};
+
+	struct Totals {
+		size_t files = 0;
+		size_t bytes = 0;
+		size_t payload_bytes = 0;
+		size_t projected_bytes = 0;
+	};
+
+	/** Content of one directory, sorted so that the report is stable */
+	struct Listing {
+		std::vector<fs::path> directories;
+		std::vector<std::string> files;
+		std::string error;
+	};
+
+	bool IsXyzName(const fs::path& path) {
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return extension == ".xyz";
+	}
+
+	void ListDirectory(const fs::path& directory, Listing& listing) {
+		std::error_code ec;
+		for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+			// Linked directories are not followed, they can form loops
+			std::error_code type_ec;
+			if (it->is_symlink(type_ec) && it->is_directory(type_ec)) {
+				continue;
+			}
+			if (it->is_directory(type_ec)) {
+				listing.directories.push_back(it->path());
+			} else if (it->is_regular_file(type_ec) && IsXyzName(it->path())) {
+				listing.files.push_back(it->path().string());
+			}
+		}
+		if (ec) {
+			listing.error = ec.message();
+		}
+		std::sort(listing.directories.begin(), listing.directories.end());
+		std::sort(listing.files.begin(), listing.files.end());
+	}
+
+	void EstimateFile(const std::string& filename, FileEstimate& estimate) {
+		std::string folder = fs::path(filename).parent_path().generic_string();
+		estimate.folder = folder.empty() ? "." : folder;
+
+		MappedFile file;
+		if (!file.Open(filename)) {
+			estimate.error = "cannot be read";
+			return;
+		}
+		if (file.GetSize() < 8 || memcmp(file.GetData(), "XYZ1", 4) != 0) {
+			estimate.error = "not an XYZ file";
+			return;
+		}
+
+		unsigned short width;
+		unsigned short height;
+		memcpy(&width, file.GetData() + 4, 2);
+		memcpy(&height, file.GetData() + 6, 2);
+
+		uLongf xyz_size = 768 + (width * height);
+		std::vector<unsigned char> xyz_data(xyz_size);
+		if (uncompress(xyz_data.data(), &xyz_size, file.GetData() + 8,
+				static_cast<uLong>(file.GetSize() - 8)) != Z_OK) {
+			estimate.error = "XYZ error";
+			return;
+		}
+		xyz_data.resize(xyz_size);
+
+		// A crushed file is never larger than zlib level 9, but the input
+		// may already be smaller than the prediction
+		estimate.bytes = file.GetSize();
+		estimate.payload_bytes = xyz_size;
+		estimate.projected_bytes = std::min(estimate.bytes,
+			8 + Estimate::PredictZopfliSize(xyz_data));
+	}
+
+	void WriteTotals(std::ostream& out, const Totals& totals) {
+		size_t savings = totals.bytes - totals.projected_bytes;
+		out << "\"files\": " << totals.files
+			<< ", \"bytes\": " << totals.bytes
+			<< ", \"payload_bytes\": " << totals.payload_bytes
+			<< ", \"projected_bytes\": " << totals.projected_bytes
+			<< ", \"savings\": " << savings
+			<< ", \"savings_percent\": " << std::fixed << std::setprecision(1)
+			<< (totals.bytes ? savings * 100.0 / totals.bytes : 0.0);
+	}
+}
+
+size_t DryRun::Report(const std::vector<std::string>& paths, WorkerPool& pool,
+		std::ostream& out) {
+	std::vector<std::string> files;
+	std::vector<std::pair<std::string, std::string>> errors;
+
+	// Breadth first, all directories of a level are listed in parallel
+	std::vector<fs::path> level;
+	for (const std::string& path : paths) {
+		std::error_code ec;
+		if (fs::is_directory(path, ec)) {
+			level.push_back(path);
+		} else {
+			files.push_back(path);
+		}
+	}
+	while (!level.empty()) {
+		std::vector<Listing> listings(level.size());
+		pool.ParallelFor(level.size(), [&](size_t i) {
+			ListDirectory(level[i], listings[i]);
+		});
+
+		std::vector<fs::path> next_level;
+		for (size_t i = 0; i < level.size(); ++i) {
+			Listing& listing = listings[i];
+			if (!listing.error.empty()) {
+				errors.emplace_back(level[i].string(), listing.error);
+			}
+			files.insert(files.end(), listing.files.begin(), listing.files.end());
+			next_level.insert(next_level.end(), listing.directories.begin(),
+				listing.directories.end());
+		}
+		level.swap(next_level);
+	}
+
+	std::vector<FileEstimate> estimates(files.size());
+	pool.ParallelFor(files.size(), [&](size_t i) {
+		EstimateFile(files[i], estimates[i]);
+	});
+
+	std::map<std::string, Totals> folders;
+	Totals total;
+	for (size_t i = 0; i < files.size(); ++i) {
+		const FileEstimate& estimate = estimates[i];
+		if (!estimate.error.empty()) {
+			errors.emplace_back(files[i], estimate.error);
+			continue;
+		}
+		for (Totals* totals : { &folders[estimate.folder], &total }) {
+			totals->files++;
+			totals->bytes += estimate.bytes;
+			totals->payload_bytes += estimate.payload_bytes;
+			totals->projected_bytes += estimate.projected_bytes;
+		}
+	}
+
+	out << "{\n  \"folders\": [";
+	bool first = true;
+	for (const auto& folder : folders) {
+		out << (first ? "\n" : ",\n") << "    {\"path\": " << JsonString(folder.first) << ", ";
+		WriteTotals(out, folder.second);
+		out << "}";
+		first = false;
+	}
+	out << "\n  ],\n  \"total\": {";
+	WriteTotals(out, total);
+	out << "},\n  \"errors\": [";
+	first = true;
+	for (const auto& error : errors) {
+		out << (first ? "\n" : ",\n") << "    {\"path\": " << JsonString(error.first)
+			<< ", \"error\": " << JsonString(error.second) << "}";
+		first = false;
+	}
+	out << (errors.empty() ? "]\n}" : "\n  ]\n}") << std::endl;
+
+	return errors.size();
+}
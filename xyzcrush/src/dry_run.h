@@ -0,0 +1,46 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_DRY_RUN
+#define XYZCRUSH_DRY_RUN
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+namespace DryRun {
+	/**
+	 * Predicts what crushing would save without compressing or writing
+	 * anything. Directories are searched recursively for XYZ files, both
+	 * the search and the estimates run on the pool.
+	 *
+	 * The report is JSON with the files, bytes, predicted bytes and savings
+	 * of every folder and of all of them together, and the files that could
+	 * not be read.
+	 *
+	 * @param paths XYZ files and directories
+	 * @param pool worker threads
+	 * @param out receives the report
+	 * @return number of unreadable files and directories
+	 */
+	size_t Report(const std::vector<std::string>& paths, WorkerPool& pool,
+		std::ostream& out);
+}
+
+#endif
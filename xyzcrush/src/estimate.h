@@ -0,0 +1,41 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_ESTIMATE
+#define XYZCRUSH_ESTIMATE
+
+#include <cstddef>
+#include <vector>
+
+namespace Estimate {
+	/**
+	 * Predicts the size of the Zopfli stream of a payload from a zlib level 9
+	 * pass, in a fraction of the Zopfli time.
+	 *
+	 * When zlib can shrink the data Zopfli usually ends 8 to 14% below it,
+	 * the better zlib compresses the more Zopfli finds beyond it. When zlib
+	 * cannot the data is close to noise and Zopfli cannot do better either.
+	 * The prediction only depends on the zlib size, images that compress
+	 * alike with zlib get the same ratio.
+	 *
+	 * @param xyz_data 768 byte palette followed by the pixel indices
+	 * @return predicted size of the zlib stream in bytes
+	 */
+	size_t PredictZopfliSize(const std::vector<unsigned char>& xyz_data);
+}
+
+#endif
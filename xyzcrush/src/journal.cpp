@@ -0,0 +1,125 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "journal.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+
+namespace {
+	const std::string header = "xyzcrush journal 2\n";
+
+	/** Parses "<input key> <options key> <output key> <output size> <path>". */
+	bool ParseLine(const std::string& line, std::string& path, Journal::Entry& entry) {
+		unsigned long long input_key, options_key, output_key, output_size;
+		int path_start = 0;
+		if (sscanf(line.c_str(), "%16llx %16llx %16llx %llu %n", &input_key,
+				&options_key, &output_key, &output_size, &path_start) != 4 ||
+				path_start == 0) {
+			return false;
+		}
+		path = line.substr(path_start);
+		entry.input_key = input_key;
+		entry.options_key = options_key;
+		entry.output_key = output_key;
+		entry.output_size = static_cast<size_t>(output_size);
+		return !path.empty();
+	}
+}
+
+bool Journal::Open(const std::string& filename) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::ifstream in(filename, std::ios::binary);
+	bool empty = true;
+	if (in) {
+		std::string content((std::istreambuf_iterator<char>(in)),
+			std::istreambuf_iterator<char>());
+		if (!content.empty()) {
+			if (content.compare(0, header.size(), header) != 0) {
+				return false;
+			}
+			empty = false;
+		}
+
+		size_t pos = empty ? 0 : header.size();
+		for (;;) {
+			size_t end = content.find('\n', pos);
+			if (end == std::string::npos) {
+				break;
+			}
+			std::string path;
+			Entry entry;
+			if (ParseLine(content.substr(pos, end - pos), path, entry)) {
+				entries[path] = entry;
+			}
+			pos = end + 1;
+		}
+		in.close();
+
+		// Drop a cut off line, new lines would be appended to it
+		if (!empty && pos != content.size()) {
+			std::error_code ec;
+			std::filesystem::resize_file(filename, pos, ec);
+			if (ec) {
+				return false;
+			}
+		}
+	}
+
+	file.open(filename, std::ios::binary | std::ios::app);
+	if (!file) {
+		return false;
+	}
+	if (empty) {
+		file << header;
+		file.flush();
+	}
+	return true;
+}
+
+bool Journal::Find(const std::string& path, Entry& entry) const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = entries.find(path);
+	if (it == entries.end()) {
+		return false;
+	}
+	entry = it->second;
+	return true;
+}
+
+void Journal::Record(const std::string& path, const Entry& entry) {
+	// A line break in the path would end the line early
+	if (path.find_first_of("\r\n") != std::string::npos) {
+		return;
+	}
+
+	char keys[96];
+	snprintf(keys, sizeof(keys), "%016" PRIx64 " %016" PRIx64 " %016" PRIx64 " %llu ",
+		entry.input_key, entry.options_key, entry.output_key,
+		static_cast<unsigned long long>(entry.output_size));
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	entries[path] = entry;
+	file << keys << path << '\n';
+	// The line must be complete when the run gets interrupted
+	file.flush();
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_JOURNAL
+#define XYZCRUSH_JOURNAL
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * On-disk list of the input files a run has finished, so that a restarted
+ * run can skip them.
+ *
+ * The file is text: a header line followed by one line per finished file
+ * with the hash of the input, the hash of the options, the hash and the size
+ * of the written output and the input path. Lines are appended once the output is in place, a
+ * later line of the same path replaces an earlier one and a line cut off
+ * by an interrupted run is ignored on load.
+ *
+ * All methods may be called from several threads.
+ */
+class Journal {
+public:
+	/** Outcome of a finished file. */
+	struct Entry {
+		/** Hash of the input file */
+		uint64_t input_key = 0;
+		/** Hash of the options the output was written with */
+		uint64_t options_key = 0;
+		/** Hash of the output file */
+		uint64_t output_key = 0;
+		size_t output_size = 0;
+	};
+
+	/**
+	 * Reads the journal file and opens it for appending. A missing file is
+	 * created.
+	 *
+	 * @param filename journal file
+	 * @return false when the file cannot be used as journal
+	 */
+	bool Open(const std::string& filename);
+
+	/**
+	 * @param path input path as given on the command line
+	 * @param entry receives the entry of the path
+	 * @return true when the path was finished before
+	 */
+	bool Find(const std::string& path, Entry& entry) const;
+
+	/**
+	 * Remembers a finished file and appends it to the journal file.
+	 *
+	 * @param path input path as given on the command line
+	 * @param entry outcome of the file
+	 */
+	void Record(const std::string& path, const Entry& entry);
+
+private:
+	std::unordered_map<std::string, Entry> entries;
+	std::ofstream file;
+	mutable std::mutex mutex;
+};
+
+#endif
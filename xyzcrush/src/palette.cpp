@@ -0,0 +1,202 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "palette.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+	/** Maps every old palette index to its new index */
+	using Permutation = std::array<unsigned char, 256>;
+
+	/**
+	 * Builds a permutation that puts the listed indices right after index 0.
+	 * All unlisted indices follow in their original order.
+	 */
+	Permutation FromOrder(const std::vector<int>& order) {
+		Permutation perm;
+		std::array<bool, 256> placed = {};
+		int next = 1;
+
+		perm[0] = 0;
+		placed[0] = true;
+		for (int index : order) {
+			perm[index] = static_cast<unsigned char>(next++);
+			placed[index] = true;
+		}
+		for (int i = 1; i < 256; ++i) {
+			if (!placed[i]) {
+				perm[i] = static_cast<unsigned char>(next++);
+			}
+		}
+		return perm;
+	}
+
+	void Apply(const std::vector<unsigned char>& src, const Permutation& perm,
+			std::vector<unsigned char>& dst) {
+		dst.resize(src.size());
+		for (int i = 0; i < 256; ++i) {
+			memcpy(&dst[perm[i] * 3], &src[i * 3], 3);
+		}
+		for (size_t i = 768; i < src.size(); ++i) {
+			dst[i] = perm[src[i]];
+		}
+	}
+
+	/** Returns the zlib compressed size of data, used to rank the orders */
+	uLong Score(const std::vector<unsigned char>& data, std::vector<Bytef>& buffer) {
+		uLongf size = static_cast<uLongf>(buffer.size());
+		if (compress2(buffer.data(), &size, data.data(), data.size(),
+				Z_BEST_COMPRESSION) != Z_OK) {
+			return static_cast<uLong>(-1);
+		}
+		return size;
+	}
+
+	/**
+	 * Greedy chain through the co-occurrence graph: every next color is the
+	 * one that is most often adjacent to the previously placed color, so that
+	 * neighbouring pixels get close indices.
+	 */
+	std::vector<int> ChainOrder(const std::vector<int>& used,
+			const std::vector<unsigned>& adjacent, const std::array<size_t, 256>& counts) {
+		std::vector<int> order;
+		std::array<bool, 256> placed = {};
+		int last = 0;
+
+		while (order.size() < used.size()) {
+			int best = -1;
+			for (int c : used) {
+				if (placed[c]) {
+					continue;
+				}
+				if (best == -1 || adjacent[last * 256 + c] > adjacent[last * 256 + best] ||
+						(adjacent[last * 256 + c] == adjacent[last * 256 + best] &&
+						counts[c] > counts[best])) {
+					best = c;
+				}
+			}
+			placed[best] = true;
+			order.push_back(best);
+			last = best;
+		}
+		return order;
+	}
+}
+
+bool Palette::Optimize(const std::vector<unsigned char>& xyz_data, int width,
+		std::vector<unsigned char>& reordered) {
+	if (xyz_data.size() <= 768 || width <= 0) {
+		return false;
+	}
+
+	const unsigned char* pixels = &xyz_data[768];
+	size_t num_pixels = xyz_data.size() - 768;
+
+	std::array<size_t, 256> counts = {};
+	std::array<size_t, 256> first_seen;
+	first_seen.fill(num_pixels);
+	std::vector<unsigned> adjacent(256 * 256, 0);
+
+	for (size_t i = 0; i < num_pixels; ++i) {
+		int c = pixels[i];
+		if (counts[c]++ == 0) {
+			first_seen[c] = i;
+		}
+		if (i % width != 0 && pixels[i - 1] != c) {
+			adjacent[c * 256 + pixels[i - 1]]++;
+			adjacent[pixels[i - 1] * 256 + c]++;
+		}
+		if (i >= static_cast<size_t>(width) && pixels[i - width] != c) {
+			adjacent[c * 256 + pixels[i - width]]++;
+			adjacent[pixels[i - width] * 256 + c]++;
+		}
+	}
+
+	std::vector<int> used;
+	for (int i = 1; i < 256; ++i) {
+		if (counts[i] > 0) {
+			used.push_back(i);
+		}
+	}
+	if (used.size() < 2) {
+		return false;
+	}
+
+	auto luma = [&xyz_data](int i) {
+		return 299 * xyz_data[i * 3] + 587 * xyz_data[i * 3 + 1] + 114 * xyz_data[i * 3 + 2];
+	};
+
+	std::vector<std::vector<int>> candidates;
+
+	std::vector<int> order = used;
+	std::stable_sort(order.begin(), order.end(), [&luma](int a, int b) {
+		return luma(a) < luma(b);
+	});
+	candidates.push_back(order);
+
+	order = used;
+	std::stable_sort(order.begin(), order.end(), [&counts](int a, int b) {
+		return counts[a] > counts[b];
+	});
+	candidates.push_back(order);
+
+	order = used;
+	std::stable_sort(order.begin(), order.end(), [&first_seen](int a, int b) {
+		return first_seen[a] < first_seen[b];
+	});
+	candidates.push_back(order);
+
+	candidates.push_back(ChainOrder(used, adjacent, counts));
+
+	std::vector<Bytef> buffer(compressBound(static_cast<uLong>(xyz_data.size())));
+	uLong best_score = Score(xyz_data, buffer);
+	std::vector<unsigned char> candidate;
+	bool found = false;
+
+	for (const auto& candidate_order : candidates) {
+		Apply(xyz_data, FromOrder(candidate_order), candidate);
+		uLong score = Score(candidate, buffer);
+		if (score < best_score) {
+			best_score = score;
+			reordered.swap(candidate);
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+bool Palette::IsSameImage(const std::vector<unsigned char>& a,
+		const std::vector<unsigned char>& b) {
+	if (a.size() != b.size() || a.size() < 768) {
+		return false;
+	}
+
+	for (size_t i = 768; i < a.size(); ++i) {
+		int index_a = a[i];
+		int index_b = b[i];
+		if ((index_a == 0) != (index_b == 0) ||
+				memcmp(&a[index_a * 3], &b[index_b * 3], 3) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of xyzcrush. Copyright (c) 2026 xyzcrush authors.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef XYZCRUSH_PALETTE
+#define XYZCRUSH_PALETTE
+
+#include <vector>
+
+namespace Palette {
+	/**
+	 * Searches for an order of the palette that makes the XYZ payload
+	 * compress better. The candidate orders are scored with a quick zlib
+	 * pass.
+	 * Index 0 never moves because it is the transparent color and every
+	 * pixel keeps its RGB value.
+	 *
+	 * Deflate codes a relabeled image with the same matches and the same
+	 * symbol frequencies, so the order only changes the Huffman tree headers
+	 * and the palette bytes. Expect small gains, the zlib score only
+	 * approximates what the final encoder makes of them.
+	 *
+	 * @param xyz_data 768 byte palette followed by the pixel indices
+	 * @param width image width, for the vertical neighbours
+	 * @param reordered receives the reordered payload
+	 * @return true when an order scoring better than the current one was found
+	 */
+	bool Optimize(const std::vector<unsigned char>& xyz_data, int width,
+		std::vector<unsigned char>& reordered);
+
+	/**
+	 * Compares two XYZ payloads by the image they show, so a payload with a
+	 * reordered palette equals the original one.
+	 *
+	 * @param a first payload
+	 * @param b second payload
+	 * @return true when every pixel has the same color and transparency
+	 */
+	bool IsSameImage(const std::vector<unsigned char>& a,
+		const std::vector<unsigned char>& b);
+}
+
+#endif
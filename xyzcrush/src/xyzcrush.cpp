@@ -16,15 +16,40 @@
  */
 
 #include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 #include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
 #ifdef _WIN32
-# include <algorithm>
+#  include <windows.h>
+#  define PSAPI_VERSION 2
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#  include <unistd.h>
 #endif
+#include <argparse.hpp>
 #include "zlib_container.h"
+#include "warmstart.h"
+#include "atomic_file.h"
+#include "crush_cache.h"
+#include "dry_run.h"
+#include "estimate.h"
+#include "journal.h"
+#include "json.h"
+#include "mapped_file.h"
+#include "palette.h"
+#include "worker_pool.h"
+#include "zopfli_callbacks.h"
 
 # ifdef __MINGW64_VERSION_MAJOR
 int _dowildcard = -1; /* enable wildcard expansion for mingw-w64 */
@@ -73,8 +98,705 @@ std::string GetPath(const std::string& str) {
 	return s;
 }
 
+/** Encoder that --strategies can try next to the others. */
+struct Strategy {
+	const char* name;
+	/** zlib strategy of a level 9 zlib run, -1 for Zopfli */
+	int zlib_strategy;
+	/** Zopfli splits into several blocks */
+	bool split;
+};
+
+static const Strategy strategies[] = {
+	{ "zopfli", -1, true },
+	{ "zopfli-single", -1, false },
+	{ "zlib", Z_DEFAULT_STRATEGY, false },
+	{ "zlib-filtered", Z_FILTERED, false },
+	{ "zlib-rle", Z_RLE, false },
+	{ "zlib-huffman", Z_HUFFMAN_ONLY, false },
+};
+
+/** Settings shared by all files of a run. */
+struct CrushSettings {
+	ZopfliOptions zopfli;
+	/** Search a better palette order before compressing */
+	bool reorder_palette = false;
+	/** Try the rows above for matches, the chain limit is in zopfli */
+	bool row_matches = false;
+	/** Start from the parse of the input stream, never output more */
+	bool incremental = false;
+	/** Time for all Zopfli runs of a file in milliseconds, 0 for no limit */
+	int budget_ms = 0;
+	/** Keep files with a predicted gain below this percentage, 0 crushes all */
+	double min_gain = 0;
+	/** Measure the Zopfli phases for --stats */
+	bool stats = false;
+	/** Encoders tried on every file, empty for Zopfli alone */
+	std::vector<const Strategy*> strategies;
+	/** Worker threads, run the strategies of a file */
+	WorkerPool* pool = nullptr;
+	/** Results of earlier runs, may be null */
+	CrushCache* cache = nullptr;
+	/** Files finished by earlier runs, may be null */
+	Journal* journal = nullptr;
+	/** Describes the options above for the cache and journal keys */
+	std::string cache_options;
+};
+
+/** Outcome of crushing a single input file. */
+struct CrushResult {
+	/** Report line, goes to stderr when error is set */
+	std::string message;
+	bool error = false;
+	bool done = false;
+	/** The estimate predicted too little gain, the file was kept */
+	bool skipped = false;
+	/** The stream came from the cache */
+	bool cached = false;
+	/** The stream came from an earlier file with the same image */
+	bool copy = false;
+	/** An earlier run finished the file, it was left alone */
+	bool journaled = false;
+	/** Size of the input file */
+	size_t input_size = 0;
+	/** Size of the written file */
+	size_t output_size = 0;
+	/** Size of the decompressed payload */
+	size_t payload_size = 0;
+	/** Time spent decompressing the input */
+	double inflate_ms = 0;
+	/** Time spent in Zopfli */
+	double zopfli_ms = 0;
+	/**
+	 * Time of the Zopfli phases by ZopfliPhase, summed over the threads that
+	 * ran them. Only measured for --stats.
+	 */
+	double phase_ms[3] = {};
+	/** Optimization iterations of all blocks, seeds and palettes */
+	int iterations = 0;
+	/** Final zlib stream, only kept when duplicates of the file reuse it */
+	std::vector<unsigned char> stream;
+};
+
+/** Zopfli phase times of one file, written by all threads working on it. */
+struct PhaseTimes {
+	std::atomic<int64_t> ns[3] = {};
+	std::atomic<int> iterations{0};
+};
+
+/**
+ * Adds the time of a Zopfli phase to the PhaseTimes given as context.
+ * type: ZopfliTraceFun
+ */
+static void TraceZopfli(void* context, ZopfliPhase phase, int end, int iterations) {
+	// Phases do not nest on a thread, one start time per phase is enough
+	thread_local std::chrono::steady_clock::time_point start[3];
+	auto now = std::chrono::steady_clock::now();
+	if (!end) {
+		start[phase] = now;
+		return;
+	}
+	PhaseTimes& times = *static_cast<PhaseTimes*>(context);
+	times.ns[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		now - start[phase]).count();
+	times.iterations += iterations;
+}
+
+/**
+ * Zopfli compresses data into a zlib stream.
+ *
+ * @param options Zopfli options
+ * @param data data to compress
+ * @param stream receives the zlib stream
+ * @param budget_ms time limit, 0 for no limit
+ */
+static void Compress(const ZopfliOptions& options,
+	const std::vector<unsigned char>& data, std::vector<unsigned char>& stream,
+	double budget_ms = 0) {
+	size_t comp_size = 0;
+	unsigned char* comp_data = 0;
+
+	ZopfliOptions run_options = options;
+	Budget budget = { std::chrono::steady_clock::now(), budget_ms, data.size() };
+	if (budget_ms > 0) {
+		run_options.stop = IsBudgetUsed;
+		run_options.stop_context = &budget;
+	}
+
+	ZopfliZlibCompress(&run_options, data.data(), data.size(), &comp_data, &comp_size);
+	stream.assign(comp_data, comp_data + comp_size);
+	free(comp_data);
+}
+
+/**
+ * Checks that a zlib stream decodes to the image of an XYZ payload, the
+ * palette may be ordered differently.
+ *
+ * @param stream zlib stream
+ * @param xyz_data payload
+ * @param decoded scratch buffer
+ */
+static bool IsStreamOf(const std::vector<unsigned char>& stream,
+		const std::vector<unsigned char>& xyz_data,
+		std::vector<unsigned char>& decoded) {
+	uLongf size = static_cast<uLongf>(xyz_data.size());
+	decoded.resize(size);
+
+	if (uncompress(decoded.data(), &size, stream.data(),
+			static_cast<uLong>(stream.size())) != Z_OK || size != xyz_data.size()) {
+		return false;
+	}
+	return decoded == xyz_data || Palette::IsSameImage(decoded, xyz_data);
+}
+
+/**
+ * Compresses data with zlib at level 9.
+ *
+ * @param data data to compress
+ * @param strategy zlib strategy
+ * @param stream receives the zlib stream, empty on failure
+ */
+static void CompressZlib(const std::vector<unsigned char>& data, int strategy,
+		std::vector<unsigned char>& stream) {
+	z_stream z = {};
+	if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15, 9, strategy) != Z_OK) {
+		stream.clear();
+		return;
+	}
+	stream.resize(deflateBound(&z, static_cast<uLong>(data.size())));
+	z.next_in = const_cast<Bytef*>(data.data());
+	z.avail_in = static_cast<uInt>(data.size());
+	z.next_out = stream.data();
+	z.avail_out = static_cast<uInt>(stream.size());
+	int status = deflate(&z, Z_FINISH);
+	stream.resize(status == Z_STREAM_END ? z.total_out : 0);
+	deflateEnd(&z);
+}
+
+/**
+ * Compresses data with every strategy of the settings on the worker pool and
+ * keeps the smallest stream that decodes to data.
+ *
+ * All strategies run to the end at the same time, so the result does not
+ * depend on which one finishes first.
+ *
+ * @param settings settings with the strategies
+ * @param options Zopfli options
+ * @param data data to compress
+ * @param stream receives the zlib stream
+ * @param budget_ms time limit of each Zopfli run, 0 for no limit
+ * @return the winning strategy
+ */
+static const Strategy* CompressAll(const CrushSettings& settings,
+		const ZopfliOptions& options, const std::vector<unsigned char>& data,
+		std::vector<unsigned char>& stream, double budget_ms) {
+	const std::vector<const Strategy*>& tried = settings.strategies;
+	std::vector<std::vector<unsigned char>> streams(tried.size());
+	std::vector<char> valid(tried.size());
+	settings.pool->ParallelFor(tried.size(), [&](size_t i) {
+		const Strategy& strategy = *tried[i];
+		if (strategy.zlib_strategy < 0) {
+			ZopfliOptions run_options = options;
+			run_options.blocksplitting = strategy.split;
+			Compress(run_options, data, streams[i], budget_ms);
+		} else {
+			CompressZlib(data, strategy.zlib_strategy, streams[i]);
+		}
+		std::vector<unsigned char> decoded;
+		valid[i] = IsStreamOf(streams[i], data, decoded);
+	});
+
+	// The strategy named first wins ties
+	size_t best = tried.size();
+	for (size_t i = 0; i < tried.size(); ++i) {
+		if (valid[i] && (best == tried.size() || streams[i].size() < streams[best].size())) {
+			best = i;
+		}
+	}
+	if (best == tried.size()) {
+		Compress(options, data, stream, budget_ms);
+		return &strategies[0];
+	}
+	stream.swap(streams[best]);
+	return tried[best];
+}
+
+/**
+ * Compresses data with Zopfli, or with all strategies when there are
+ * some.
+ *
+ * @return the winning strategy, null without strategies
+ */
+static const Strategy* Encode(const CrushSettings& settings,
+		const ZopfliOptions& options, const std::vector<unsigned char>& data,
+		std::vector<unsigned char>& stream, double budget_ms) {
+	if (settings.strategies.empty()) {
+		Compress(options, data, stream, budget_ms);
+		return nullptr;
+	}
+	return CompressAll(settings, options, data, stream, budget_ms);
+}
+
+/** Returns whether the file exists with exactly the given content. */
+static bool HasContent(const std::string& filename,
+		const std::vector<unsigned char>& data) {
+	MappedFile file;
+	return file.Open(filename) && file.GetSize() == data.size() &&
+		(data.empty() || memcmp(file.GetData(), data.data(), data.size()) == 0);
+}
+
+/**
+ * Checks that the output of a journal entry is still in place.
+ *
+ * @param filename output file
+ * @param entry journal entry
+ * @param stream receives the zlib stream of the file, may be null
+ */
+static bool HasJournaledOutput(const std::string& filename,
+		const Journal::Entry& entry, std::vector<unsigned char>* stream) {
+	MappedFile file;
+	if (!file.Open(filename) || file.GetSize() != entry.output_size ||
+			file.GetSize() < 8 ||
+			CrushCache::MakeKey(file.GetData(), file.GetSize(), "") != entry.output_key) {
+		return false;
+	}
+	if (stream) {
+		stream->assign(file.GetData() + 8, file.GetData() + file.GetSize());
+	}
+	return true;
+}
+
+/**
+ * Buffers of a worker thread. They are reused for every file the thread
+ * crushes and keep the capacity of the largest file seen so far, so that
+ * small files do not go through the allocator.
+ */
+struct Arena {
+	std::vector<unsigned char> xyz_data;
+	std::vector<unsigned char> comp_data;
+	std::vector<unsigned char> file_data;
+	std::vector<unsigned char> scratch;
+};
+
+/** @return the arena of the calling thread */
+static Arena& GetArena() {
+	thread_local Arena arena;
+	return arena;
+}
+
+/**
+ * Identifies the image of an XYZ file, files with the same key show the
+ * same image.
+ *
+ * @param filename input XYZ file
+ * @param key receives the key
+ * @return false when the file is not a readable XYZ file
+ */
+static bool GetImageKey(const std::string& filename, uint64_t& key) {
+	Arena& arena = GetArena();
+	MappedFile file;
+	if (!file.Open(filename) || file.GetSize() < 8 ||
+			memcmp(file.GetData(), "XYZ1", 4) != 0) {
+		return false;
+	}
+
+	unsigned short width;
+	unsigned short height;
+	memcpy(&width, file.GetData() + 4, 2);
+	memcpy(&height, file.GetData() + 6, 2);
+
+	uLongf xyz_size = 768 + (width * height);
+	std::vector<unsigned char>& xyz_data = arena.xyz_data;
+	xyz_data.resize(xyz_size);
+	if (uncompress(xyz_data.data(), &xyz_size, file.GetData() + 8,
+			static_cast<uLong>(file.GetSize() - 8)) != Z_OK) {
+		return false;
+	}
+
+	std::ostringstream size;
+	size << width << "x" << height;
+	key = CrushCache::MakeKey(xyz_data.data(), xyz_size, size.str());
+	return true;
+}
+
+/**
+ * Recompresses an XYZ file and writes it into the current directory.
+ *
+ * @param filename input XYZ file
+ * @param settings compression settings
+ * @param result receives the report line
+ * @param original result of an earlier file with the same image, its stream
+ *        is used instead of compressing again. May be null.
+ * @param original_name name of that file for the report
+ * @param keep_stream store the final stream in result
+ */
+void CrushFile(const std::string& filename,
+	const CrushSettings& settings, CrushResult& result,
+	const CrushResult* original = nullptr, const std::string& original_name = "",
+	bool keep_stream = false);
+
+void CrushFile(const std::string& filename,
+	const CrushSettings& settings, CrushResult& result,
+	const CrushResult* original, const std::string& original_name,
+	bool keep_stream) {
+	std::ostringstream msg;
+	Arena& arena = GetArena();
+
+	MappedFile file;
+	if (!file.Open(filename)) {
+		msg << "Error reading file " << filename << ".";
+		result.message = msg.str();
+		result.error = true;
+		return;
+	}
+
+	const unsigned char* file_data = file.GetData();
+	long size = static_cast<long>(file.GetSize());
+	result.input_size = size;
+
+	if (size < 8 || memcmp(file_data, "XYZ1", 4) != 0) {
+		std::string header(reinterpret_cast<const char*>(file_data),
+			std::min<size_t>(size, 4));
+		msg << "Input file " << filename
+			<< " is not an XYZ file: '" << header << "'.";
+		result.message = msg.str();
+		result.error = true;
+		return;
+	}
+
+	// A file finished with the same options by an interrupted run is
+	// skipped. Its input can be the output already, when that replaced it
+	// in place
+	std::string xyz_filename = GetFilename(filename) + std::string(".xyz");
+	uint64_t input_key = 0;
+	uint64_t options_key = 0;
+	if (settings.journal) {
+		input_key = CrushCache::MakeKey(file_data, size, "");
+		options_key = CrushCache::MakeKey(nullptr, 0, settings.cache_options);
+		Journal::Entry entry;
+		if (settings.journal->Find(filename, entry) &&
+				entry.options_key == options_key &&
+				(entry.input_key == input_key || entry.output_key == input_key) &&
+				HasJournaledOutput(xyz_filename, entry,
+					keep_stream ? &result.stream : nullptr)) {
+			result.journaled = true;
+			result.output_size = entry.output_size;
+			msg << "Input file " << filename << ": " << size << "->"
+				<< entry.output_size << " (" << entry.output_size * 100 / size
+				<< "%) (journaled)";
+			result.message = msg.str();
+			return;
+		}
+	}
+
+	unsigned short width;
+	unsigned short height;
+	memcpy(&width, file_data + 4, 2);
+	memcpy(&height, file_data + 6, 2);
+
+	const Bytef* compressed_xyz_data = file_data + 8;
+	size_t compressed_xyz_size = size - 8;
+
+	uLongf xyz_size = 768 + (width * height);
+	std::vector<Bytef>& xyz_data = arena.xyz_data;
+	xyz_data.resize(xyz_size);
+
+	auto inflate_start = std::chrono::steady_clock::now();
+	int status = uncompress(xyz_data.data(), &xyz_size,
+		compressed_xyz_data, static_cast<uLong>(compressed_xyz_size));
+	std::chrono::duration<double, std::milli> inflate_time =
+		std::chrono::steady_clock::now() - inflate_start;
+	result.inflate_ms = inflate_time.count();
+
+	if (status != Z_OK) {
+		msg << "XYZ error in file " << filename << ".";
+		result.message = msg.str();
+		result.error = true;
+		return;
+	}
+
+	xyz_data.resize(xyz_size);
+
+	uint64_t cache_key = 0;
+	std::vector<unsigned char>& comp_data = arena.comp_data;
+
+	// The key can collide, only reuse a stream that decodes to this image
+	bool duplicate = original &&
+		IsStreamOf(original->stream, xyz_data, arena.scratch);
+	if (duplicate) {
+		// This copy may already be smaller, for example crushed before
+		if (compressed_xyz_size < original->stream.size()) {
+			comp_data.assign(compressed_xyz_data,
+				compressed_xyz_data + compressed_xyz_size);
+		} else {
+			comp_data = original->stream;
+		}
+	}
+
+	bool cached = false;
+	if (settings.cache && !duplicate) {
+		cache_key = CrushCache::MakeKey(xyz_data.data(), xyz_data.size(),
+			settings.cache_options);
+		cached = settings.cache->Find(cache_key, comp_data) &&
+			IsStreamOf(comp_data, xyz_data, arena.scratch);
+	}
+
+	result.payload_size = xyz_data.size();
+	if (!cached && !duplicate && settings.min_gain > 0) {
+		double predicted = static_cast<double>(Estimate::PredictZopfliSize(xyz_data));
+		double gain = (compressed_xyz_size - predicted) * 100 / size;
+		if (gain < settings.min_gain) {
+			comp_data.assign(compressed_xyz_data,
+				compressed_xyz_data + compressed_xyz_size);
+			result.skipped = true;
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	const Strategy* winner = nullptr;
+	if (!cached && !duplicate && !result.skipped) {
+		ZopfliOptions zopfli = settings.zopfli;
+		if (settings.row_matches) {
+			zopfli.rowwidth = width;
+		}
+		PhaseTimes phase_times;
+		if (settings.stats) {
+			zopfli.trace = TraceZopfli;
+			zopfli.trace_context = &phase_times;
+		}
+
+		ZopfliWarmStart warm;
+		bool warm_start = settings.incremental &&
+			ZopfliInitWarmStart(compressed_xyz_data, compressed_xyz_size,
+				xyz_data.data(), xyz_data.size(), &warm);
+		if (warm_start) {
+			zopfli.warmstart = &warm;
+		}
+
+		// The palette order is picked by its zlib size and only the winner
+		// is compressed. The input stream only describes the original order,
+		// so a warm start keeps it
+		std::vector<unsigned char> reordered_data;
+		bool reordered = settings.reorder_palette && !warm_start &&
+			Palette::Optimize(xyz_data, width, reordered_data);
+
+		winner = Encode(settings, zopfli, reordered ? reordered_data : xyz_data,
+			comp_data, settings.budget_ms);
+
+		if (warm_start) {
+			ZopfliCleanWarmStart(&warm);
+		}
+
+		std::chrono::duration<double, std::milli> elapsed =
+			std::chrono::steady_clock::now() - start;
+		result.zopfli_ms = elapsed.count();
+		for (int phase = 0; phase < 3; ++phase) {
+			result.phase_ms[phase] = phase_times.ns[phase] / 1e6;
+		}
+		result.iterations = phase_times.iterations;
+
+		if (settings.incremental && compressed_xyz_size <= comp_data.size()) {
+			comp_data.assign(compressed_xyz_data,
+				compressed_xyz_data + compressed_xyz_size);
+			winner = nullptr;
+		}
+	}
+
+	if (settings.cache && !duplicate && !result.skipped) {
+		// The input can be smaller when it was crushed with other options,
+		// the cache keeps the best stream known for the payload
+		bool improved = !cached;
+		if (compressed_xyz_size < comp_data.size()) {
+			comp_data.assign(compressed_xyz_data,
+				compressed_xyz_data + compressed_xyz_size);
+			improved = true;
+		}
+		if (improved) {
+			settings.cache->Store(cache_key, comp_data.data(), comp_data.size());
+		}
+	}
+
+	if (keep_stream) {
+		result.stream = comp_data;
+	}
+
+	// The output can replace the input, which must not be mapped then
+	file.Close();
+
+	std::vector<unsigned char>& xyz_file_data = arena.file_data;
+	xyz_file_data.resize(8);
+	memcpy(&xyz_file_data[0], "XYZ1", 4);
+	memcpy(&xyz_file_data[4], &width, 2);
+	memcpy(&xyz_file_data[6], &height, 2);
+	xyz_file_data.insert(xyz_file_data.end(), comp_data.begin(), comp_data.end());
+
+	// Rewriting an identical file only touches its timestamp
+	if (!HasContent(xyz_filename, xyz_file_data) &&
+			!WriteFileAtomic(xyz_filename, xyz_file_data)) {
+		msg << "Error writing file " << xyz_filename << ".";
+		result.message = msg.str();
+		result.error = true;
+		return;
+	}
+
+	// Only once the output is complete
+	if (settings.journal) {
+		Journal::Entry entry;
+		entry.input_key = input_key;
+		entry.options_key = options_key;
+		entry.output_key = CrushCache::MakeKey(xyz_file_data.data(),
+			xyz_file_data.size(), "");
+		entry.output_size = xyz_file_data.size();
+		settings.journal->Record(filename, entry);
+	}
+
+	size_t comp_size = comp_data.size();
+	result.output_size = comp_size + 8;
+	result.cached = cached;
+	result.copy = duplicate;
+	msg << "Input file " << filename << ": " << size << "->"
+		<< comp_size + 8 << " (" << (comp_size + 8) * 100 / size << "%)";
+	if (winner) {
+		msg << " [" << winner->name << "]";
+	}
+	if (duplicate) {
+		msg << " (copy of " << original_name << ")";
+	} else if (cached) {
+		msg << " (cached)";
+	} else if (result.skipped) {
+		msg << " (skipped)";
+	}
+	result.message = msg.str();
+}
+
+/**
+ * Describes every setting that changes the compressed stream, results of
+ * runs with other settings are not reused.
+ */
+static std::string GetCacheOptions(const CrushSettings& settings) {
+	const ZopfliOptions& zopfli = settings.zopfli;
+	std::ostringstream options;
+
+	options << "xyzcrush " << PACKAGE_VERSION
+		<< " i" << zopfli.numiterations
+		<< " b" << zopfli.blocksplitting << zopfli.blocksplittinglast
+		<< " m" << zopfli.blocksplittingmax
+		<< " s" << zopfli.numseeds << " t" << zopfli.numstalliterations
+		<< " f" << zopfli.fixedpointcosts
+		<< " w" << zopfli.maxchainhits
+		<< " inc" << settings.incremental
+		<< " ms" << settings.budget_ms
+		<< " r" << settings.reorder_palette;
+	for (const Strategy* strategy : settings.strategies) {
+		options << " x" << strategy->name;
+	}
+	return options.str();
+}
+
+/** Returns the peak memory use of the process in bytes, 0 if unknown. */
+static size_t GetPeakMemory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#  ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss);
+#  else
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#  endif
+#endif
+}
+
+/** Returns str as a CSV field, quoted when necessary. */
+static std::string CsvField(const std::string& str) {
+	if (str.find_first_of(",\"\r\n") == std::string::npos) {
+		return str;
+	}
+	std::string out = "\"";
+	for (char c : str) {
+		if (c == '"') {
+			out += '"';
+		}
+		out += c;
+	}
+	return out + "\"";
+}
+
+/** Returns how the output of a file came about, for --stats. */
+static const char* GetStatus(const CrushResult& result) {
+	if (result.error) {
+		return "error";
+	} else if (result.journaled) {
+		return "journaled";
+	} else if (result.copy) {
+		return "copy";
+	} else if (result.cached) {
+		return "cached";
+	} else if (result.skipped) {
+		return "skipped";
+	}
+	return "crushed";
+}
+
+/**
+ * Writes the --stats record of a file.
+ *
+ * @param out stream to write to
+ * @param json JSON instead of CSV
+ * @param filename input file
+ * @param result result of the file
+ * @param peak_memory peak memory use of the process so far
+ * @param first the record is the first one
+ */
+static void WriteStats(std::ostream& out, bool json, const std::string& filename,
+		const CrushResult& result, size_t peak_memory, bool first) {
+	std::ostringstream record;
+	record << std::fixed << std::setprecision(3);
+	if (json) {
+		record << (first ? "\n" : ",\n") << "  {\"file\": " << JsonString(filename)
+			<< ", \"status\": \"" << GetStatus(result) << "\""
+			<< ", \"input_bytes\": " << result.input_size
+			<< ", \"output_bytes\": " << result.output_size
+			<< ", \"payload_bytes\": " << result.payload_size
+			<< ", \"inflate_ms\": " << result.inflate_ms
+			<< ", \"zopfli_ms\": " << result.zopfli_ms
+			<< ", \"lz77_ms\": " << result.phase_ms[ZOPFLI_PHASE_LZ77]
+			<< ", \"split_ms\": " << result.phase_ms[ZOPFLI_PHASE_SPLIT]
+			<< ", \"encode_ms\": " << result.phase_ms[ZOPFLI_PHASE_ENCODE]
+			<< ", \"iterations\": " << result.iterations
+			<< ", \"peak_memory\": " << peak_memory << "}";
+	} else {
+		record << CsvField(filename) << "," << GetStatus(result)
+			<< "," << result.input_size << "," << result.output_size
+			<< "," << result.payload_size << "," << result.inflate_ms
+			<< "," << result.zopfli_ms
+			<< "," << result.phase_ms[ZOPFLI_PHASE_LZ77]
+			<< "," << result.phase_ms[ZOPFLI_PHASE_SPLIT]
+			<< "," << result.phase_ms[ZOPFLI_PHASE_ENCODE]
+			<< "," << result.iterations << "," << peak_memory << "\n";
+	}
+	out << record.str();
+}
+
+/** Returns the file size or 0 when it cannot be determined. */
+static long GetFileSize(const std::string& filename) {
+	struct stat file_info;
+	if (stat(filename.c_str(), &file_info) != 0) {
+		return 0;
+	}
+	return static_cast<long>(file_info.st_size);
+}
+
 int main(int argc, char* argv[]) {
-	ZopfliOptions zopfli_options;
+	CrushSettings settings;
+	ZopfliOptions& zopfli_options = settings.zopfli;
 	ZopfliInitOptions(&zopfli_options);
 	zopfli_options.verbose = 0;
 	zopfli_options.verbose_more = 0;
@@ -82,85 +804,364 @@ int main(int argc, char* argv[]) {
 	zopfli_options.blocksplitting = 1;
 	zopfli_options.blocksplittinglast = 0;
 	zopfli_options.blocksplittingmax = 15;
+	zopfli_options.getcontext = GetZopfliContext;
+
+	std::vector<std::string> files;
+	int jobs = static_cast<int>(WorkerPool::GetDefaultThreadCount());
+	bool parallel_blocks = false;
+	int seeds = 1;
+	std::string cache_file;
+	std::string journal_file;
+	int match_cache_mb = 0;
+	int row_matches = 0;
+	bool timing = false;
+	bool fixed_point = false;
+	bool no_simd = false;
+	bool dry_run = false;
+	std::string stats_format;
+	std::string strategy_list;
 
-	if (argc < 2) {
-		std::cout << "Usage: " << argv[0]
-			<< " filename" << std::endl;
+	argparse::ArgumentParser cli("xyzcrush", PACKAGE_VERSION);
+	cli.set_usage_max_line_width(100);
+	cli.add_description("Recompresses RPG Maker XYZ images into smaller files.\n"
+		"The results are written into the current directory.");
+	cli.add_epilog("Homepage " PACKAGE_URL " - Report bugs at: " PACKAGE_BUGREPORT);
+
+	cli.add_argument("FILE").nargs(argparse::nargs_pattern::at_least_one)
+		.store_into(files).help("XYZ files to crush, with --dry-run also directories");
+	cli.add_argument("-j", "--jobs").store_into(jobs)
+		.help("Number of files crushed in parallel\n"
+			"(default: number of hardware threads)").metavar("N");
+	cli.add_argument("-p", "--parallel-blocks").store_into(parallel_blocks)
+		.help("Also compress the deflate blocks of a single file and\n"
+			"search their split points in parallel, helps when there\n"
+			"are fewer files than threads");
+	cli.add_argument("-s", "--seeds").store_into(seeds)
+		.help("Number of differently randomized optimizations per block,\n"
+			"run on the worker threads, the smallest wins (default: 1)")
+		.metavar("K");
+	cli.add_argument("-r", "--reorder-palette").store_into(settings.reorder_palette)
+		.help("Reorder the palette when a quick zlib pass finds a better\n"
+			"order, only that order is compressed. The colors and the\n"
+			"transparent index 0 stay the same. Not used with -i");
+	cli.add_argument("-b", "--budget-ms").store_into(settings.budget_ms)
+		.help("Time limit for the optimization of a file in milliseconds.\n"
+			"The iterations then also stop once they no longer shrink\n"
+			"the file, small files may get more of them").metavar("MS");
+	cli.add_argument("-g", "--min-gain").store_into(settings.min_gain)
+		.help("Predict the Zopfli size as 86 to 92% of a quick zlib\n"
+			"level 9 pass, more for data zlib compresses worse, and\n"
+			"keep files whose predicted gain is below PCT percent\n"
+			"unchanged (default: 0, crush all)")
+		.metavar("PCT");
+	cli.add_argument("-m", "--match-cache-mb").store_into(match_cache_mb)
+		.help("Memory limit of the match cache of one block in MB. Less\n"
+			"memory is slower, the output stays the same\n"
+			"(default: 0, about 28 bytes per image byte)").metavar("MB");
+	cli.add_argument("-f", "--fixed-point").store_into(fixed_point)
+		.help("Use faster integer costs in the optimization, the result\n"
+			"can be slightly larger or smaller");
+	cli.add_argument("-w", "--row-matches").store_into(row_matches)
+		.help("Walk at most HITS hash chain entries per position when\n"
+			"searching matches and try the rows above instead. Faster,\n"
+			"a little larger; 32 is a good start (default: 0, full search)")
+		.metavar("HITS");
+	cli.add_argument("--no-simd").store_into(no_simd)
+		.help("Compare match lengths without SSE2 or AVX2, the output\n"
+			"stays the same");
+	cli.add_argument("-i", "--incremental").store_into(settings.incremental)
+		.help("Start from the deflate stream of the input and its blocks\n"
+			"instead of from scratch. Repeated runs refine the file and\n"
+			"it never gets larger");
+	cli.add_argument("-x", "--strategies").store_into(strategy_list)
+		.help("Compress every file with each of these comma separated\n"
+			"encoders and keep the smallest result: zopfli,\n"
+			"zopfli-single (no block splitting), zlib, zlib-filtered,\n"
+			"zlib-rle and zlib-huffman. All of them run to the end,\n"
+			"the time adds up (default: zopfli)").metavar("LIST");
+	cli.add_argument("-t", "--timing").store_into(timing)
+		.help("Print the throughput and the peak memory use at the end");
+	cli.add_argument("-n", "--dry-run").store_into(dry_run)
+		.help("Only predict the savings with the estimate of --min-gain\n"
+			"and print them per folder as JSON, directories are\n"
+			"searched for XYZ files. Nothing is written");
+	cli.add_argument("--stats").store_into(stats_format)
+		.help("Print sizes, timings of the Zopfli phases, iterations and\n"
+			"peak memory of every file to stdout, as json or csv. The\n"
+			"usual report goes to stderr then").metavar("FORMAT");
+	cli.add_argument("-l", "--journal").store_into(journal_file)
+		.help("Record the finished files in FILE. A run with the same\n"
+			"FILE and options skips them, so an interrupted run can\n"
+			"continue where it stopped").metavar("FILE");
+	cli.add_argument("-c", "--cache").store_into(cache_file)
+		.help("Remember the results in FILE, files crushed before with\n"
+			"the same options are then skipped").metavar("FILE");
+
+	try {
+		cli.parse_args(argc, argv);
+	} catch (const std::exception& err) {
+		std::cerr << err.what() << std::endl;
+		std::cerr << cli.usage() << std::endl;
 		return 1;
 	}
 
-	unsigned int errors = 0;
-	char header[5];
+	if (jobs < 1) {
+		std::cerr << "--jobs must be at least 1." << std::endl;
+		return 1;
+	}
+	if (seeds < 1) {
+		std::cerr << "--seeds must be at least 1." << std::endl;
+		return 1;
+	}
+	zopfli_options.numseeds = seeds;
+	if (settings.budget_ms < 0) {
+		std::cerr << "--budget-ms must not be negative." << std::endl;
+		return 1;
+	}
+	if (match_cache_mb < 0) {
+		std::cerr << "--match-cache-mb must not be negative." << std::endl;
+		return 1;
+	}
+	zopfli_options.maxcachesize = static_cast<size_t>(match_cache_mb) * 1024 * 1024;
+	zopfli_options.fixedpointcosts = fixed_point;
+	zopfli_options.scalarmatch = no_simd;
+	if (row_matches < 0) {
+		std::cerr << "--row-matches must not be negative." << std::endl;
+		return 1;
+	}
+	zopfli_options.maxchainhits = row_matches;
+	settings.row_matches = row_matches > 0;
+	if (settings.min_gain < 0) {
+		std::cerr << "--min-gain must not be negative." << std::endl;
+		return 1;
+	}
+	if (settings.budget_ms > 0) {
+		// The time and the stall limit end the iterations, the count is only
+		// a cap, so small images can go further than the usual 15
+		zopfli_options.numiterations = 60;
+		zopfli_options.numstalliterations = 5;
+	}
+
+	if (!stats_format.empty() && stats_format != "json" && stats_format != "csv") {
+		std::cerr << "--stats must be json or csv." << std::endl;
+		return 1;
+	}
+	settings.stats = !stats_format.empty();
+	std::istringstream strategy_names(strategy_list);
+	for (std::string name; std::getline(strategy_names, name, ',');) {
+		auto strategy = std::find_if(std::begin(strategies), std::end(strategies),
+			[&name](const Strategy& s) { return name == s.name; });
+		if (strategy == std::end(strategies)) {
+			std::cerr << "Unknown strategy " << name << "." << std::endl;
+			return 1;
+		}
+		settings.strategies.push_back(&*strategy);
+	}
+	if (settings.strategies.size() == 1 && settings.strategies[0] == &strategies[0]) {
+		// Zopfli alone is the default
+		settings.strategies.clear();
+	}
+	bool stats_json = stats_format == "json";
 
-	for (int arg = 1; arg < argc; arg++) {
-		std::ifstream file(argv[arg],
-			std::ios::binary | std::ios::ate);
-		if (!file) {
-			std::cerr << "Error reading file " << argv[arg] << "."
-				<< std::endl;
-			errors++;
-			continue;
+	if (dry_run) {
+		WorkerPool pool(static_cast<unsigned>(jobs));
+		return DryRun::Report(files, pool, std::cout) > 0 ? 1 : 0;
+	}
+
+	CrushCache cache;
+	if (!cache_file.empty()) {
+		if (!cache.Open(cache_file)) {
+			std::cerr << "Cache file " << cache_file << " is not usable." << std::endl;
+			return 1;
 		}
+		settings.cache = &cache;
+	}
 
-		long size = file.tellg();
-		header[4] = '\0';
+	Journal journal;
+	if (!journal_file.empty()) {
+		if (!journal.Open(journal_file)) {
+			std::cerr << "Journal file " << journal_file << " is not usable." << std::endl;
+			return 1;
+		}
+		settings.journal = &journal;
+	}
+	settings.cache_options = GetCacheOptions(settings);
 
-		file.seekg(0, std::ios::beg);
-		file.read(header, 4);
+	// Files with the same output name are crushed one after another in
+	// command line order, so that the last one wins like in a serial run
+	std::vector<std::vector<size_t>> groups;
+	std::vector<size_t> group_of(files.size());
+	std::unordered_map<std::string, size_t> group_of_name;
+	for (size_t i = 0; i < files.size(); ++i) {
+		auto it = group_of_name.emplace(GetFilename(files[i]), groups.size()).first;
+		if (it->second == groups.size()) {
+			groups.emplace_back();
+		}
+		groups[it->second].push_back(i);
+		group_of[i] = it->second;
+	}
 
-		if (memcmp(header, "XYZ1", 4) != 0) {
-			std::cerr << "Input file " << argv[arg]
-				<< " is not an XYZ file: '" << header << "'." << std::endl;
-			errors++;
-			continue;
+	// Start with the largest files, small ones fill the gaps at the end
+	std::vector<size_t> order(groups.size());
+	std::vector<long> sizes(groups.size());
+	for (size_t g = 0; g < groups.size(); ++g) {
+		order[g] = g;
+		for (size_t i : groups[g]) {
+			sizes[g] = std::max(sizes[g], GetFileSize(files[i]));
 		}
+	}
+	std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+		return sizes[a] > sizes[b];
+	});
 
-		unsigned short width;
-		unsigned short height;
-		file.read((char*) &width, 2);
-		file.read((char*) &height, 2);
+	std::vector<CrushResult> results(files.size());
+	std::mutex report_mutex;
+	size_t next_report = 0;
+	unsigned int errors = 0;
 
-		int compressed_xyz_size = size - 8;
-		Bytef* compressed_xyz_data = new Bytef[compressed_xyz_size];
+	WorkerPool pool(static_cast<unsigned>(jobs));
+	settings.pool = &pool;
+	if (parallel_blocks || seeds > 1) {
+		zopfli_options.runjobs = RunZopfliJobs;
+		zopfli_options.runjobs_context = &pool;
+		zopfli_options.speculativesplit = parallel_blocks;
+	}
 
-		file.read((char*) compressed_xyz_data, compressed_xyz_size);
+	// With --stats the records are the only output on stdout
+	std::ostream& report = settings.stats ? std::cerr : std::cout;
+	if (stats_json) {
+		std::cout << "[";
+	} else if (settings.stats) {
+		std::cout << "file,status,input_bytes,output_bytes,payload_bytes,"
+			"inflate_ms,zopfli_ms,lz77_ms,split_ms,encode_ms,iterations,"
+			"peak_memory\n";
+	}
 
-		uLongf xyz_size = 768 + (width * height);
-		Bytef* xyz_data = new Bytef[xyz_size];
+	auto start = std::chrono::steady_clock::now();
 
-		int status = uncompress(xyz_data, &xyz_size, compressed_xyz_data,
-			compressed_xyz_size);
+	// Copies of an image are crushed once, after the first one is done.
+	// Files that share their output name are left out, their order within
+	// the group comes first.
+	std::vector<uint64_t> keys(files.size());
+	std::vector<char> has_key(files.size());
+	pool.ParallelFor(files.size(), [&](size_t i) {
+		has_key[i] = groups[group_of[i]].size() == 1 && GetImageKey(files[i], keys[i]);
+	});
 
-		if (status != Z_OK) {
-			std::cerr << "XYZ error in file " << argv[arg] << "." << std::endl;
-			errors++;
-			continue;
+	std::vector<size_t> original_of(files.size());
+	std::vector<char> has_copies(files.size());
+	std::unordered_map<uint64_t, size_t> first_of_key;
+	for (size_t i = 0; i < files.size(); ++i) {
+		original_of[i] = i;
+		if (has_key[i]) {
+			auto it = first_of_key.emplace(keys[i], i).first;
+			original_of[i] = it->second;
+			has_copies[it->second] |= it->second != i;
 		}
-		delete[] compressed_xyz_data;
+	}
 
-		// Compress XYZ data
-		size_t comp_size = 0;
-		unsigned char* comp_data = 0;
+	std::vector<size_t> original_groups;
+	std::vector<size_t> copies;
+	for (size_t g : order) {
+		size_t first = groups[g][0];
+		if (original_of[first] != first) {
+			copies.push_back(first);
+		} else {
+			original_groups.push_back(g);
+		}
+	}
 
-		ZopfliZlibCompress(&zopfli_options, xyz_data, xyz_size, &comp_data,
-			&comp_size);
+	auto crush = [&](size_t i) {
+		CrushResult result;
+		size_t o = original_of[i];
+		if (o == i) {
+			CrushFile(files[i], settings, result, nullptr, "", has_copies[i] != 0);
+		} else {
+			CrushFile(files[i], settings, result, &results[o], files[o]);
+		}
 
-		delete[] xyz_data;
+		// Report in command line order, independent of completion order
+		std::lock_guard<std::mutex> lock(report_mutex);
+		results[i] = std::move(result);
+		results[i].done = true;
+		for (; next_report < results.size() && results[next_report].done; ++next_report) {
+			const CrushResult& r = results[next_report];
+			if (r.error) {
+				std::cerr << r.message << std::endl;
+				errors++;
+			} else {
+				report << r.message << std::endl;
+			}
+			if (settings.stats) {
+				WriteStats(std::cout, stats_json, files[next_report], r,
+					GetPeakMemory(), next_report == 0);
+			}
+		}
+	};
+	pool.ParallelFor(original_groups.size(), [&](size_t job) {
+		for (size_t i : groups[original_groups[job]]) {
+			crush(i);
+		}
+	});
+	pool.ParallelFor(copies.size(), [&](size_t job) { crush(copies[job]); });
+
+	if (stats_json) {
+		std::cout << "\n]" << std::endl;
+	}
+
+	if (!copies.empty()) {
+		report << copies.size() << " files are copies of other files:" << std::endl;
+		for (size_t i = 0; i < files.size(); ++i) {
+			if (!has_copies[i]) {
+				continue;
+			}
+			report << "  " << files[i];
+			for (size_t c = i + 1; c < files.size(); ++c) {
+				if (original_of[c] == i) {
+					report << " = " << files[c];
+				}
+			}
+			report << std::endl;
+		}
+	}
 
-		std::stringstream ss;
-		ss << GetFilename(argv[arg]) + std::string(".xyz");
-		std::string xyz_filename = ss.str();
-		std::ofstream xyz_file(xyz_filename.c_str(), std::ofstream::binary);
-		xyz_file.write("XYZ1", 4);
-		xyz_file.write(reinterpret_cast<char*>(&width), 2);
-		xyz_file.write(reinterpret_cast<char*>(&height), 2);
-		xyz_file.write(reinterpret_cast<char*>(comp_data), comp_size);
-		xyz_file.close();
-		delete[] comp_data;
+	if (timing) {
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		size_t payload_size = 0;
+		for (const CrushResult& r : results) {
+			payload_size += r.payload_size;
+		}
+
+		report << std::fixed << std::setprecision(1)
+			<< "Crushed " << payload_size / 1024.0 << " KB of images in "
+			<< elapsed.count() << " s (" << payload_size / 1024.0 / elapsed.count()
+			<< " KB/s), peak memory " << GetPeakMemory() / (1024.0 * 1024.0)
+			<< " MB." << std::endl;
+	}
 
-		std::cout << "Input file " << argv[arg] << ": " << size << "->"
-			<< comp_size + 8 << " (" << (comp_size + 8) * 100 / size << "%)"
-			<< std::endl;
+	if (settings.min_gain > 0) {
+		// The saved time is extrapolated from the files crushed in this run
+		size_t skipped = 0;
+		size_t skipped_size = 0;
+		size_t crushed_size = 0;
+		double crushed_ms = 0;
+		for (const CrushResult& r : results) {
+			if (r.skipped) {
+				skipped++;
+				skipped_size += r.payload_size;
+			} else if (r.zopfli_ms > 0) {
+				crushed_size += r.payload_size;
+				crushed_ms += r.zopfli_ms;
+			}
+		}
+
+		report << "Skipped " << skipped << " of " << files.size() << " files";
+		if (skipped > 0 && crushed_size > 0) {
+			double saved_s = skipped_size * crushed_ms / crushed_size / 1000;
+			report << ", saving about " << std::fixed << std::setprecision(1)
+				<< saved_s << " s";
+		}
+		report << "." << std::endl;
 	}
 
 	if (errors > 0) {